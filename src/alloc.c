@@ -1,64 +1,273 @@
 #include "alloc.h"
 
 /**
- * @brief Returns 1 if is end dir
+ * @brief Counts the blocks a group's bitmap covers, the last group may be cut short by the end
+ * of the disk
  *
- * @param directory
- * @return int
+ * @param disk_info
+ * @param group
+ * @return int64_t
+ */
+int64_t allocateGroupBlockCount(DiskInfo* disk_info, int64_t group) {
+  int64_t bit_count = disk_info->block_count - 1 - group * disk_info->blocks_per_group;
+
+  return bit_count > disk_info->blocks_per_group ? disk_info->blocks_per_group : bit_count;
+}
+
+/**
+ * @brief Marks a run of blocks as used if all of them are still free. The group must be locked.
+ *
+ * @param disk_info
+ * @param group
+ * @param first_bit
+ * @param length
+ * @return int8_t 1 if the run was claimed
  */
-int32_t isEndDirectory(Directory* directory) {
-  if (directory->file_type == EXT2_FT_UNKNOWN) {
-    return 1;
+int8_t allocateClaimRun(DiskInfo* disk_info, int64_t group, int64_t first_bit, int64_t length) {
+  int8_t* bitmap = cacheLoadBitmap(disk_info, group, BITMAP_BLOCK);
+
+  if (bitmap == NULL) {
+    return 0;
   }
 
-  return 0;
+  for (int64_t bit = first_bit; bit < first_bit + length; bit++) {
+    if (testBit(bitmap[bit / 8], bit % 8)) {
+      return 0;
+    }
+  }
+
+  // Mark the run as used, thus alloc'ing it. It reaches the disk with the next bitmap flush.
+  for (int64_t bit = first_bit; bit < first_bit + length; bit++) {
+    bitmap[bit / 8] |= (1 << (bit % 8));
+  }
+
+  cacheMarkBitmap(disk_info, group, BITMAP_BLOCK, length);
+
+  return 1;
 }
 
 /**
- * @brief Allocates a block
+ * @brief Claims a run of physically consecutive blocks. Groups are searched from the goal's
+ * group on, the first run of count blocks wins, otherwise the longest run seen. Full groups are
+ * skipped without reading their bitmaps. Only one group is locked at a time, so the longest run
+ * is checked again once its group is locked and the search starts over if it was taken.
  *
  * @param disk_info
- * @return int32_t
+ * @param goal Block the run should start at if it can, 0 for no preference
+ * @param count Blocks wanted
+ * @param allocated Set to the number of blocks claimed, at most count
+ * @return int64_t First block of the run, -1 if the disk is full
  */
-int32_t allocateBlock(DiskInfo* disk_info) {
-  GroupDesc group_desc;
-  int8_t    buffer[disk_info->block_size];
+int64_t allocateBlockRange(DiskInfo* disk_info, int64_t goal, int64_t count, int64_t* allocated) {
+  int64_t goal_group  = goal > 0 ? (goal - 1) / disk_info->blocks_per_group : 0;
+  int64_t goal_bit    = goal > 0 ? (goal - 1) % disk_info->blocks_per_group : 0;
+  int64_t best_group  = -1;
+  int64_t best_bit    = -1;
+  int64_t best_length = 0;
+  int64_t group       = goal_group;
+  int64_t travelled   = -1;  // Groups moved on from the goal's group
+
+  if (goal_group >= disk_info->group_count) {
+    goal_group = 0;
+    goal_bit   = 0;
+  }
 
-  for (int32_t group = 0; group < disk_info->group_count; group++) {
-    ioGroupDescriptor(disk_info, &group_desc, group, IOMODE_READ);
-    ioBlock(disk_info, group_desc.bg_block_bitmap, (int8_t*)&buffer, IOMODE_READ);
+  // Every group once, then the part of the goal's group before the goal
+  while (best_length < count) {
+    int64_t next = cacheFindGroup(disk_info, BITMAP_BLOCK,
+                                  travelled < 0 ? goal_group : (group + 1) % disk_info->group_count);
 
-    for (int32_t pos = 0; pos < disk_info->blocks_per_group / 8; pos++) {
-      int32_t real_block_pos = (pos * 8) + (group * disk_info->blocks_per_group);
+    if (next == -1) {
+      break;
+    }
 
-      if (real_block_pos > disk_info->block_count) {
-        break;
-      }
+    travelled = travelled < 0 ? (next - goal_group + disk_info->group_count) % disk_info->group_count
+                              : travelled + (next - group - 1 + disk_info->group_count) %
+                                                disk_info->group_count +
+                                  1;
+    group = next;
 
-      int32_t bit = findFreeBit(buffer[pos], 0);
+    if (travelled > disk_info->group_count) {
+      break;
+    }
 
-      if (bit != -1) {
-        int32_t free_block_pos = 1 + bit + (pos * 8) + (group * disk_info->blocks_per_group);
+    cacheLockGroup(disk_info, group);
 
-        // Mark bitmap as used, thus alloc'ing it
-        buffer[pos] |= (1 << bit);
+    int8_t* bitmap = cacheLoadBitmap(disk_info, group, BITMAP_BLOCK);
+    int64_t length = 0;
 
-        // Just write the entire block back to the disk
-        ioBlock(disk_info, group_desc.bg_block_bitmap, (int8_t*)&buffer, IOMODE_WRITE);
+    if (bitmap == NULL) {
+      cacheUnlockGroup(disk_info, group);
+      break;
+    }
 
-        disk_info->free_blocks--;
+    int64_t start = travelled == 0 ? goal_bit : 0;
+    int64_t bit   = findFreeRun(bitmap, start, allocateGroupBlockCount(disk_info, group), count,
+                                &length);
 
-        return free_block_pos;
-      }
+    if (bit == -1 && start == 0) {
+      // The group's free count was wrong, don't look at it again
+      cacheSetGroupFull(disk_info, group, BITMAP_BLOCK, 1);
+    }
+
+    // A whole run is taken while the group is still locked
+    if (length >= count && allocateClaimRun(disk_info, group, bit, count)) {
+      cacheUnlockGroup(disk_info, group);
+
+      *allocated = count;
+      return 1 + bit + group * disk_info->blocks_per_group;
+    }
+
+    cacheUnlockGroup(disk_info, group);
+
+    if (length > best_length) {
+      best_group  = group;
+      best_bit    = bit;
+      best_length = length;
     }
   }
 
+  *allocated = best_length;
+
+  if (best_length == 0 && disk_info->prealloc_cache->reserved > 0) {
+    // The only free blocks left are held for growing files
+    cacheReleaseWindows(disk_info);
+    return allocateBlockRange(disk_info, goal, count, allocated);
+  }
+
+  if (best_length == 0) {
+    return -1;
+  }
+
+  cacheLockGroup(disk_info, best_group);
+  int8_t is_claimed = allocateClaimRun(disk_info, best_group, best_bit, best_length);
+  cacheUnlockGroup(disk_info, best_group);
+
+  // Another thread got to the run first
+  if (!is_claimed) {
+    return allocateBlockRange(disk_info, goal, count, allocated);
+  }
+
+  return 1 + best_bit + best_group * disk_info->blocks_per_group;
+}
+
+/**
+ * @brief Allocates a block
+ *
+ * @param disk_info
+ * @param goal Block to try first, 0 for no preference
+ * @return int32_t
+ */
+int32_t allocateBlock(DiskInfo* disk_info, int64_t goal) {
+  int64_t allocated = 0;
+  int64_t block_no  = allocateBlockRange(disk_info, goal, 1, &allocated);
+
+  if (block_no != -1) {
+    return block_no;
+  }
+
   printf("alloc: allocateBlock(): error: Failed to alloc block\n");
-  exit(EXIT_FAILURE);
+  ioAbort(disk_info);
 
   return -1;
 }
 
+/**
+ * @brief Picks where an INode's next blocks should go: right after the last block before
+ * first_block, or else the start of the INode's own group so data sits near its INode table
+ *
+ * @param disk_info
+ * @param inode
+ * @param inode_no 0 if unknown
+ * @param first_block First block about to be allocated
+ * @return int64_t 0 for no preference
+ */
+int64_t allocateGoal(DiskInfo* disk_info, INode* inode, int64_t inode_no, int64_t first_block) {
+  IndirectRange range = calculateIndirectRange(disk_info);
+
+  if (first_block > 0) {
+    int32_t block_no = 0;
+    ioFileBlockHelper(disk_info, &block_no, inode, &range, first_block - 1);
+
+    if (block_no != 0) {
+      return block_no + 1;
+    }
+  }
+
+  if (inode_no > 0) {
+    return 1 + (inode_no - 1) / disk_info->inodes_per_group * disk_info->blocks_per_group;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Hands out the next block of a run, claiming a new run when it is used up. Indirect
+ * blocks are zeroed so they don't point at stale blocks.
+ *
+ * @param disk_info
+ * @param run
+ * @param wanted Blocks still needed, the size of the next run
+ * @param is_indirect
+ * @return int32_t
+ */
+int32_t allocateRunBlock(DiskInfo* disk_info, BlockRun* run, int64_t wanted, int8_t is_indirect) {
+  if (run->left == 0) {
+    // Carry on right after the previous run
+    run->next = allocateBlockRange(disk_info, run->next, wanted, &run->left);
+
+    if (run->next == -1) {
+      printf("alloc: allocateRunBlock(): error: Failed to alloc block\n");
+      ioAbort(disk_info);
+    }
+  }
+
+  int32_t block_no = run->next++;
+  run->left--;
+
+  if (is_indirect) {
+    int8_t zeros[disk_info->block_size];
+    bzero(zeros, disk_info->block_size);
+    ioBlock(disk_info, block_no, zeros, IOMODE_WRITE);
+  }
+
+  return block_no;
+}
+
+/**
+ * @brief Gives back a run of claimed blocks that ended up unused, without touching their contents
+ *
+ * @param disk_info
+ * @param block_no First block of the run, the run must not cross groups
+ * @param count
+ */
+void deallocateBlockRange(DiskInfo* disk_info, int64_t block_no, int64_t count) {
+  int64_t group = (block_no - 1) / disk_info->blocks_per_group;
+  int64_t first = (block_no - 1) % disk_info->blocks_per_group;
+  int32_t freed = 0;
+
+  if (count <= 0) {
+    return;
+  }
+
+  cacheLockGroup(disk_info, group);
+
+  int8_t* bitmap = cacheLoadBitmap(disk_info, group, BITMAP_BLOCK);
+
+  if (bitmap != NULL) {
+    for (int64_t bit = first; bit < first + count; bit++) {
+      if (testBit(bitmap[bit / 8], bit % 8)) {
+        bitmap[bit / 8] &= ~(1 << (bit % 8));
+        freed++;
+      }
+    }
+
+    cacheMarkBitmap(disk_info, group, BITMAP_BLOCK, -freed);
+  }
+
+  cacheUnlockGroup(disk_info, group);
+}
+
 /**
  * @brief Deallocates a block
  *
@@ -67,206 +276,402 @@ int32_t allocateBlock(DiskInfo* disk_info) {
  * @return int32_t
  */
 void deallocateBlock(DiskInfo* disk_info, int32_t block_no) {
-  GroupDesc group_desc;
-  int8_t    buffer[disk_info->block_size];
+  int8_t buffer[disk_info->block_size];
 
-  int32_t group = block_no / disk_info->blocks_per_group;
-  int32_t pos   = (block_no % disk_info->blocks_per_group) / 8;
-  int8_t  bit   = block_no % 8;
+  // Bit 0 of the first group is block 1, the same numbering allocateBlock() hands out
+  int32_t group = (block_no - 1) / disk_info->blocks_per_group;
+  int32_t bit   = (block_no - 1) % disk_info->blocks_per_group;
 
   if (block_no == 0) {
     return;
   }
 
   // Dump 0's to the block we're deallocing
-  bzero(buffer, disk_info->block_size);
-  ioBlock(disk_info, block_no, (int8_t*)&buffer, IOMODE_WRITE);
+  if (disk_info->zero_freed) {
+    bzero(buffer, disk_info->block_size);
+    ioBlock(disk_info, block_no, (int8_t*)&buffer, IOMODE_WRITE);
+  }
+
+  cacheLockGroup(disk_info, group);
+
+  int8_t* bitmap = cacheLoadBitmap(disk_info, group, BITMAP_BLOCK);
+
+  // Freeing a free block must not count it twice
+  if (bitmap != NULL && testBit(bitmap[bit / 8], bit % 8)) {
+    // Flip the offending bit
+    bitmap[bit / 8] &= ~(1 << (bit % 8));
+    cacheMarkBitmap(disk_info, group, BITMAP_BLOCK, -1);
+  }
+
+  cacheUnlockGroup(disk_info, group);
+}
+
+/**
+ * @brief Places a directory entry in the slack of the first entry of a block with enough room
+ *
+ * @param disk_info
+ * @param block Directory block
+ * @param directory Entry to place, name_len must be set
+ * @return int32_t EXIT_FAILURE if the block has no room
+ */
+int32_t allocateDirectorySlot(DiskInfo* disk_info, int8_t* block, Directory* directory) {
+  int64_t needed = calculateDirectoryEntryLength(directory->name_len);
+
+  for (int64_t offset = 0; offset < disk_info->block_size;) {
+    Directory* entry = (Directory*)(block + offset);
+
+    if (entry->rec_len < 8 || offset + entry->rec_len > disk_info->block_size) {
+      printf("alloc: allocateDirectorySlot(): error: Damaged directory block\n");
+      return EXIT_FAILURE;
+    }
+
+    int64_t used = entry->inode == 0 ? 0 : calculateDirectoryEntryLength(entry->name_len);
+
+    if (entry->rec_len - used >= needed) {
+      // Split the slack off of this entry, the new entry takes the rest of its record
+      directory->rec_len = entry->rec_len - used;
+      entry->rec_len     = used;
+
+      memcpy(block + offset + used, directory, 8);
+      memcpy(block + offset + used + 8, directory->name, directory->name_len);
+      return EXIT_SUCCESS;
+    }
+
+    offset += entry->rec_len;
+  }
+
+  return EXIT_FAILURE;
+}
 
-  // Read the group desc and find the right block
-  ioGroupDescriptor(disk_info, &group_desc, group, IOMODE_READ);
-  ioBlock(disk_info, group_desc.bg_block_bitmap, (int8_t*)&buffer, IOMODE_READ);
+/**
+ * @brief Adds an empty block to the end of a directory. The caller writes the INode back.
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @return int64_t Position of the new block within the directory
+ */
+int64_t allocateDirectoryBlock(DiskInfo* disk_info, INode* inode) {
+  int8_t    buffer[disk_info->block_size];
+  int64_t   block_pos = inode->i_size / disk_info->block_size;
+  Directory empty     = { 0, disk_info->block_size, 0, EXT2_FT_UNKNOWN };
+
+  allocateINodeBlocks(disk_info, inode, 0, block_pos, block_pos + 1);
+  inode->i_size += disk_info->block_size;
 
-  // Flip the offending bit
-  buffer[pos] &= ~(1 << (bit - 1));
+  // A single unused entry covers the whole block
+  bzero(buffer, disk_info->block_size);
+  memcpy(buffer, &empty, 8);
+  ioDirectoryBlock(disk_info, inode, block_pos, buffer, IOMODE_WRITE);
 
-  // Dump the bitmap back down to the disk
-  ioBlock(disk_info, group_desc.bg_block_bitmap, (int8_t*)&buffer, IOMODE_WRITE);
-  disk_info->free_blocks++;
+  return block_pos;
 }
 
 /**
- * @brief Appends a dir table with a new entry
+ * @brief Appends a dir table with a new entry. Indexed directories place it by hash, others
+ * take the first slack with enough room, otherwise the directory grows by a block.
  *
  * @param disk_info
  * @param inode_start
  * @param directory
  */
 void allocateDirectoryEntry(DiskInfo* disk_info, int32_t inode_no, Directory* directory) {
-  INode     root_inode;
-  Directory root_dir;
-  int64_t   read_index  = 0;
-  int64_t   write_index = 0;
-  time_t    now         = time(NULL);
-
+  INode   root_inode;
+  int8_t  buffer[disk_info->block_size];
+  int64_t block_count = 0;
+  int64_t block_pos   = 0;
+  int8_t  is_placed   = 0;
+  time_t  now         = time(NULL);
+
+  // Entries of a directory are only added or removed with the directory locked
+  cacheLockINode(disk_info, inode_no);
   ioINode(disk_info, &root_inode, inode_no, IOMODE_READ);
 
-  while (1) {
-    // Read index must be a multiple of 4 to start a directory entry
-    if (read_index % 4 != 0) {
-      read_index += 4 - (read_index % 4);
+  if (htreeIsIndexed(&root_inode)) {
+    is_placed = htreeInsert(disk_info, &root_inode, directory) == EXIT_SUCCESS;
+
+    if (!is_placed) {
+      // The index can't take the entry, so carry on without it
+      printf("alloc: allocateDirectoryEntry(): warning: Dropping the index of directory %5i\n",
+             inode_no);
+      root_inode.i_flags &= ~EXT2_INDEX_FL;
     }
+  }
 
-    read_index += ioDirectoryEntry(disk_info, &root_dir, &root_inode, read_index, IOMODE_READ);
+  block_count = root_inode.i_size / disk_info->block_size;
 
-    if (isEndDirectory(&root_dir)) {
-      // We've found the end dir! Now we overrwrite it with the new dir:
+  for (block_pos = 0; block_pos < block_count && !is_placed; block_pos++) {
+    if (ioDirectoryBlock(disk_info, &root_inode, block_pos, buffer, IOMODE_READ) ==
+        EXIT_FAILURE) {
+      cacheUnlockINode(disk_info, inode_no);
+      return;
+    }
 
-      // Jump to the start of the end dir:
-      write_index = read_index - 8 - root_dir.name_len;
-      if (write_index % 4 != 0) {
-        write_index -= 4 - (write_index % 4);
-      }
+    if (allocateDirectorySlot(disk_info, buffer, directory) == EXIT_SUCCESS) {
+      ioDirectoryBlock(disk_info, &root_inode, block_pos, buffer, IOMODE_WRITE);
+      is_placed = 1;
+    }
+  }
 
-      // Write the new directory entry to the disk:
-      write_index += ioDirectoryEntry(disk_info, directory, &root_inode, write_index, IOMODE_WRITE);
-      // printDirectory(disk_info, directory);
+  // A directory outgrowing its first block gets an index when the filesystem supports them
+  if (!is_placed && disk_info->dir_index && block_count == 1 &&
+      htreeCreate(disk_info, &root_inode) == EXIT_SUCCESS) {
+    is_placed = htreeInsert(disk_info, &root_inode, directory) == EXIT_SUCCESS;
+  }
 
-      // Now write the end dir back:
-      write_index += ioDirectoryEntry(disk_info, &root_dir, &root_inode, write_index, IOMODE_WRITE);
+  if (!is_placed) {
+    // No room anywhere, add a block to the end of the directory
+    block_pos = allocateDirectoryBlock(disk_info, &root_inode);
 
-      // Now increase INode link count (The root dir now links to it)
-      root_inode.i_links_count++;
-      root_inode.i_atime = now;
-      // And write the INode back to disk:
-      ioINode(disk_info, &root_inode, inode_no, IOMODE_WRITE);
-      return;
-    }
+    ioDirectoryBlock(disk_info, &root_inode, block_pos, buffer, IOMODE_READ);
+    allocateDirectorySlot(disk_info, buffer, directory);
+    ioDirectoryBlock(disk_info, &root_inode, block_pos, buffer, IOMODE_WRITE);
   }
+
+  // Now increase INode link count (The root dir now links to it)
+  root_inode.i_links_count++;
+  root_inode.i_atime = now;
+  // And write the INode back to disk:
+  ioINode(disk_info, &root_inode, inode_no, IOMODE_WRITE);
+
+  // Lookups of the new name (including cached misses) now resolve to it
+  cacheStoreDentry(disk_info, inode_no, directory->name, directory->inode, directory->file_type);
+  cacheUnlockINode(disk_info, inode_no);
 }
 
 /**
- * @brief Deallocatess a directory entry
+ * @brief Deallocatess a directory entry. Its space is merged into the entry before it, or it is
+ * marked unused when it starts a block.
  *
  * @param disk_info
  * @param inode_no
  * @param directory
  */
 void deallocateDirectoryEntry(DiskInfo* disk_info, int32_t inode_no, char* to_remove_name) {
-  INode     root_inode;
-  Directory current_dir;
+  DirectoryIterator iterator;
+  Directory         current_dir;
+  INode             root_inode;
 
-  // ptrs on fs
-  int32_t read_index  = 0;
-  int32_t write_index = 0;
+  cacheLockINode(disk_info, inode_no);
 
+  // The name is about to stop existing
+  cacheStoreDentry(disk_info, inode_no, to_remove_name, 0, EXT2_FT_UNKNOWN);
+
+  // Indexed directories know which leaf holds the name
   ioINode(disk_info, &root_inode, inode_no, IOMODE_READ);
 
+  if (htreeRemove(disk_info, &root_inode, to_remove_name) != HTREE_UNINDEXED ||
+      ioDirectoryOpen(disk_info, &iterator, inode_no) == EXIT_FAILURE) {
+    cacheUnlockINode(disk_info, inode_no);
+    return;
+  }
+
   // Scan for the dir we want
-  while (1) {
-    if (read_index % 4 != 0) {
-      read_index += 4 - (read_index % 4);
+  while (ioDirectoryNext(disk_info, &iterator, &current_dir) == EXIT_SUCCESS) {
+    if (strcmp(to_remove_name, current_dir.name) != 0) {
+      continue;
     }
 
-    read_index += ioDirectoryEntry(disk_info, &current_dir, &root_inode, read_index, IOMODE_READ);
+    // We found our guy to remove!
+    Directory* entry = (Directory*)(iterator.block + iterator.entry_offset);
 
-    if (strcmp(to_remove_name, current_dir.name) == 0) {
-      // We found our guy to remove!
-      write_index = read_index - 8 - current_dir.name_len;
-      break;
+    if (iterator.previous_offset == -1) {
+      entry->inode = 0;
+    } else {
+      Directory* previous = (Directory*)(iterator.block + iterator.previous_offset);
+      previous->rec_len += entry->rec_len;
     }
+
+    ioDirectoryBlock(disk_info, &iterator.inode, iterator.block_pos, iterator.block,
+                     IOMODE_WRITE);
+    break;
   }
 
-  // Move all the other dirs up
-  while (1) {
-    if (read_index % 4 != 0) {
-      read_index += 4 - (read_index % 4);
-    }
+  ioDirectoryClose(&iterator);
+  cacheUnlockINode(disk_info, inode_no);
+}
+
+/**
+ * @brief Picks the group a new INode should go in, Orlov style. Directories made in the root are
+ * spread out to the emptiest groups with the fewest directories, other directories stay in their
+ * parent's group while it has an average share of free space, and files go next to their parent.
+ * The counts are read without locking the groups, they only steer where the search starts.
+ *
+ * @param disk_info
+ * @param parent_no INode of the directory the new INode goes in
+ * @param is_directory
+ * @return int64_t Group to start looking for a free INode in
+ */
+int64_t allocateINodeGroup(DiskInfo* disk_info, int64_t parent_no, int8_t is_directory) {
+  int64_t parent_group = (parent_no - 1) / disk_info->inodes_per_group;
+  int64_t avg_inodes   = disk_info->free_inodes / disk_info->group_count;
+  int64_t avg_blocks   = disk_info->free_blocks / disk_info->group_count;
+  int64_t best_group   = -1;
+
+  if (parent_group < 0 || parent_group >= disk_info->group_count) {
+    parent_group = 0;
+  }
+
+  if (!is_directory) {
+    return parent_group;
+  }
 
-    if (write_index % 4 != 0) {
-      write_index += 4 - (write_index % 4);
+  if (parent_no == EXT2_ROOT_INO) {
+    // Top level directories go wherever there is the most room for their subtree
+    for (int64_t group = 0; group < disk_info->group_count; group++) {
+      GroupDesc* desc = &disk_info->group_descs[group];
+      GroupDesc* best = best_group == -1 ? NULL : &disk_info->group_descs[best_group];
+
+      if (desc->bg_free_inodes_count < avg_inodes || desc->bg_free_blocks_count < avg_blocks ||
+          desc->bg_free_inodes_count == 0) {
+        continue;
+      }
+
+      if (best == NULL || desc->bg_used_dirs_count < best->bg_used_dirs_count ||
+          (desc->bg_used_dirs_count == best->bg_used_dirs_count &&
+           desc->bg_free_blocks_count > best->bg_free_blocks_count)) {
+        best_group = group;
+      }
     }
+  } else {
+    // Nested directories stay close to their parent while the groups there have room
+    for (int64_t visit = 0; visit < disk_info->group_count && best_group == -1; visit++) {
+      int64_t    group = (parent_group + visit) % disk_info->group_count;
+      GroupDesc* desc  = &disk_info->group_descs[group];
+
+      if (desc->bg_free_inodes_count >= avg_inodes && desc->bg_free_blocks_count >= avg_blocks &&
+          desc->bg_free_inodes_count > 0) {
+        best_group = group;
+      }
+    }
+  }
 
-    read_index += ioDirectoryEntry(disk_info, &current_dir, &root_inode, read_index, IOMODE_READ);
-    write_index +=
-      ioDirectoryEntry(disk_info, &current_dir, &root_inode, write_index, IOMODE_WRITE);
+  // Nothing has an average share left, settle for the group with the most free INodes
+  if (best_group == -1) {
+    best_group = parent_group;
 
-    if (isEndDirectory(&current_dir)) {
-      bzero(&current_dir, sizeof(Directory));
-      ioDirectoryEntry(disk_info, &current_dir, &root_inode, write_index, IOMODE_WRITE);
-      return;
+    for (int64_t group = 0; group < disk_info->group_count; group++) {
+      if (disk_info->group_descs[group].bg_free_inodes_count >
+          disk_info->group_descs[best_group].bg_free_inodes_count) {
+        best_group = group;
+      }
     }
   }
+
+  return best_group;
 }
 
 /**
  * @brief Returns the INode no of a newly allocated INode
  * NOTE: INode number from the bitmap starts counting at 1
  *
- * @param disk_info
- * @param ext_info
+ * @param state
+ * @param parent_no INode of the directory the new INode goes in
+ * @param is_directory
  * @return int32_t
  */
-int32_t allocateINode(State* state) {
-  GroupDesc group_desc;
-  int8_t    buffer[state->disk_info->block_size];
+int32_t allocateINode(State* state, int64_t parent_no, int8_t is_directory) {
+  int64_t start = allocateINodeGroup(state->disk_info, parent_no, is_directory);
+  int64_t group;
+
+  while ((group = cacheFindGroup(state->disk_info, BITMAP_INODE, start)) != -1) {
+    cacheLockGroup(state->disk_info, group);
+
+    int8_t* bitmap = cacheLoadBitmap(state->disk_info, group, BITMAP_INODE);
+
+    if (bitmap == NULL) {
+      cacheUnlockGroup(state->disk_info, group);
+      break;
+    }
+
+    int64_t bit = findFreeBit(bitmap, 0, state->disk_info->inodes_per_group);
+
+    if (bit != -1) {
+      int32_t free_inode_pos = 1 + bit + (group * state->disk_info->inodes_per_group);
 
-  for (int32_t group = 0; group < state->disk_info->group_count; group++) {
-    ioGroupDescriptor(state->disk_info, &group_desc, group, IOMODE_READ);
-    ioBlock(state->disk_info, group_desc.bg_inode_bitmap, (int8_t*)&buffer, IOMODE_READ);
-
-    for (int32_t pos = 0; pos < state->disk_info->inodes_per_group / 8; pos++) {
-      int32_t bit = findFreeBit(buffer[pos], 0);
-
-      if (bit != -1) {
-        int32_t free_inode_pos = 1 + bit + (pos * 8) + (group * state->disk_info->inodes_per_group);
-
-        // Mark bitmap as used, thus alloc'ing it
-        buffer[pos] |= (1 << (bit));
-
-        // Just write the entire block back to the disk
-        ioBlock(state->disk_info, group_desc.bg_inode_bitmap, (int8_t*)&buffer, IOMODE_WRITE);
-
-        int16_t current_time = time(NULL);
-        // Prep the INode with our standard data so we don't have to deal with it later:
-        INode inode = { getDefaultMode(EXT2_FT_REG_FILE),
-                        state->user.user_id,
-                        0,
-                        current_time,
-                        current_time,
-                        current_time,
-                        0,
-                        state->user.group_id,
-                        0,
-                        0,
-                        0 };
-
-        ioINode(state->disk_info, &inode, free_inode_pos, IOMODE_WRITE);
-
-        state->disk_info->free_inodes--;
-        // Now we know which INode we have
-        return free_inode_pos;
+      // Mark bitmap as used, thus alloc'ing it. It reaches the disk with the next bitmap flush.
+      bitmap[bit / 8] |= (1 << (bit % 8));
+      cacheMarkBitmap(state->disk_info, group, BITMAP_INODE, 1);
+
+      if (is_directory) {
+        GroupDesc group_desc;
+        ioGroupDescriptor(state->disk_info, &group_desc, group, IOMODE_READ);
+        group_desc.bg_used_dirs_count++;
+        ioGroupDescriptor(state->disk_info, &group_desc, group, IOMODE_WRITE);
       }
+
+      cacheUnlockGroup(state->disk_info, group);
+
+      int16_t current_time = time(NULL);
+      // Prep the INode with our standard data so we don't have to deal with it later:
+      INode inode = { getDefaultMode(EXT2_FT_REG_FILE),
+                      state->user.user_id,
+                      0,
+                      current_time,
+                      current_time,
+                      current_time,
+                      0,
+                      state->user.group_id,
+                      0,
+                      0,
+                      0 };
+
+      ioINode(state->disk_info, &inode, free_inode_pos, IOMODE_WRITE);
+
+      // Now we know which INode we have
+      return free_inode_pos;
     }
+
+    // The group's free count was wrong, don't look at it again
+    cacheSetGroupFull(state->disk_info, group, BITMAP_INODE, 1);
+    cacheUnlockGroup(state->disk_info, group);
   }
 
   return -1;
 }
 
 /**
- * @brief Allocate a number of blocks for an INode
+ * @brief Blocks a file of data_blocks may take. Every indirects_per_block data blocks need one
+ * indirect block, and the single, double and triple indirect roots may need one more each.
+ *
+ * @param disk_info
+ * @param data_blocks
+ * @return int64_t
+ */
+int64_t allocateBlocksNeeded(DiskInfo* disk_info, int64_t data_blocks) {
+  IndirectRange range = calculateIndirectRange(disk_info);
+
+  return data_blocks + data_blocks / range.indirects_per_block + 3;
+}
+
+/**
+ * @brief Allocate a number of blocks for an INode. Blocks before first_block are assumed to be
+ * allocated already, so a growing file only pays for the blocks it adds. Blocks are claimed as
+ * runs with allocateBlockRange(), so the file and its indirect blocks end up laid out in order,
+ * continuing from the file's last block or starting in the INode's own group. A file that is
+ * growing claims PREALLOC_WINDOW blocks more than it needs and keeps them as a window, so its next
+ * blocks come from there without touching the bitmaps.
  *
  * @param disk_info
  * @param inode
+ * @param inode_no 0 if unknown
+ * @param first_block
  * @param blocks_count
  */
-void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count) {
-  IndirectRange range          = calculateIndirectRange(disk_info);
-  int64_t       alloced_blocks = 0;
+void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t inode_no, int64_t first_block,
+                         int64_t blocks_count) {
+  IndirectRange range = calculateIndirectRange(disk_info);
+  BlockRun      run   = { allocateGoal(disk_info, inode, inode_no, first_block), 0 };
+  int64_t       extra = first_block > 0 ? PREALLOC_WINDOW : 0;
 
-  for (int64_t block_pos = 0; block_pos < blocks_count && alloced_blocks < blocks_count;
-       block_pos++) {
+  // Carry on with the blocks set aside the last time this file grew
+  cacheTakeWindow(disk_info, run.next, &run);
+
+  for (int64_t block_pos = first_block; block_pos < blocks_count; block_pos++) {
     int32_t block_no = 0;
 
+    // Data still to come plus the indirect blocks it may need
+    int64_t wanted = allocateBlocksNeeded(disk_info, blocks_count - block_pos) + extra;
+
     if (block_pos >= range.triple_start) {
       int32_t block_index =
         (block_pos - range.triple_start) / (range.indirects_per_block) %
@@ -274,16 +679,14 @@ void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count
       int32_t block_offset = sizeof(int32_t) * block_index;
 
       if (inode->i_block[EXT2_INDIRECT_TRIPLE] == 0) {
-        inode->i_block[EXT2_INDIRECT_TRIPLE] = allocateBlock(disk_info);
-        alloced_blocks++;
+        inode->i_block[EXT2_INDIRECT_TRIPLE] = allocateRunBlock(disk_info, &run, wanted, 1);
       }
 
       ioBlockPart(disk_info, (int8_t*)&block_no, inode->i_block[EXT2_INDIRECT_TRIPLE],
                   sizeof(int32_t), block_offset, IOMODE_READ);
 
       if (block_no == 0) {
-        block_no = allocateBlock(disk_info);
-        alloced_blocks++;
+        block_no = allocateRunBlock(disk_info, &run, wanted, 1);
         ioBlockPart(disk_info, (int8_t*)&block_no, inode->i_block[EXT2_INDIRECT_TRIPLE],
                     sizeof(int32_t), block_offset, IOMODE_WRITE);
       }
@@ -296,8 +699,7 @@ void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count
       int32_t block_offset = sizeof(int32_t) * block_index;
 
       if (inode->i_block[EXT2_INDIRECT_DOUBLE] == 0) {
-        inode->i_block[EXT2_INDIRECT_DOUBLE] = allocateBlock(disk_info);
-        alloced_blocks++;
+        inode->i_block[EXT2_INDIRECT_DOUBLE] = allocateRunBlock(disk_info, &run, wanted, 1);
       }
 
       // If triple indirect was NOT called, then work off of double indirect table
@@ -311,8 +713,7 @@ void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count
                   IOMODE_READ);
 
       if (block_no == 0) {
-        block_no = allocateBlock(disk_info);
-        alloced_blocks++;
+        block_no = allocateRunBlock(disk_info, &run, wanted, 1);
         ioBlockPart(disk_info, (int8_t*)&block_no, redirect_block, sizeof(int32_t), block_offset,
                     IOMODE_WRITE);
       }
@@ -324,8 +725,7 @@ void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count
       int32_t block_offset = sizeof(int32_t) * block_index;
 
       if (inode->i_block[EXT2_INDIRECT_SINGLE] == 0) {
-        inode->i_block[EXT2_INDIRECT_SINGLE] = allocateBlock(disk_info);
-        alloced_blocks++;
+        inode->i_block[EXT2_INDIRECT_SINGLE] = allocateRunBlock(disk_info, &run, wanted, 1);
       }
 
       // If double indirect was NOT called, then work off of single indirect table
@@ -339,8 +739,7 @@ void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count
                   IOMODE_READ);
 
       if (block_no == 0) {
-        block_no = allocateBlock(disk_info);
-        alloced_blocks++;
+        block_no = allocateRunBlock(disk_info, &run, wanted, 0);
         ioBlockPart(disk_info, (int8_t*)&block_no, redirect_block, sizeof(int32_t), block_offset,
                     IOMODE_WRITE);
       }
@@ -351,62 +750,145 @@ void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count
       block_no = inode->i_block[block_pos];
 
       if (block_no == 0) {
-        block_no = allocateBlock(disk_info);
-        alloced_blocks++;
+        block_no = allocateRunBlock(disk_info, &run, wanted, 0);
         inode->i_block[block_pos] = block_no;
       }
     }
   }
 
+  // Whatever the last run had left over goes back, unless the file is likely to grow into it
+  if (extra > 0) {
+    cacheStoreWindow(disk_info, &run);
+  } else {
+    deallocateBlockRange(disk_info, run.next, run.left);
+  }
+
   inode->i_blocks = blocks_count;
 }
 
 /**
- * @brief Gets rid of a double indirect block
+ * @brief Adds a block to a list of blocks to free
  *
  * @param disk_info
+ * @param list
  * @param block_no
  */
-void deallocateDoubleIndirectBlock(DiskInfo* disk_info, int64_t block_no) {
-  int32_t buffer[disk_info->block_size / sizeof(int32_t)];
+void deallocateListBlock(DiskInfo* disk_info, BlockList* list, int64_t block_no) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+    list->blocks   = (int64_t*)realloc(list->blocks, list->capacity * sizeof(int64_t));
+
+    if (list->blocks == NULL) {
+      printf("alloc: deallocateListBlock(): error: Unable to list %ld blocks\n", list->capacity);
+      ioAbort(disk_info);
+    }
+  }
+
+  list->blocks[list->count++] = block_no;
+}
 
+/**
+ * @brief Adds a block and everything it points at to a list of blocks to free
+ *
+ * @param disk_info
+ * @param list
+ * @param block_no
+ * @param depth 0 for a data block, 1 for a single indirect block and so on
+ */
+void deallocateListTree(DiskInfo* disk_info, BlockList* list, int64_t block_no, int32_t depth) {
   if (block_no == 0) {
     return;
   }
 
-  ioBlock(disk_info, block_no, (int8_t*)&buffer, IOMODE_READ);
+  if (depth > 0) {
+    int32_t buffer[disk_info->block_size / sizeof(int32_t)];
+
+    ioBlock(disk_info, block_no, (int8_t*)&buffer, IOMODE_READ);
 
-  for (int32_t pos = 0; pos < disk_info->block_size / sizeof(int32_t); pos++) {
-    if (buffer[pos] != 0) {
-      deallocateBlock(disk_info, buffer[pos]);
+    for (int32_t pos = 0; pos < disk_info->block_size / sizeof(int32_t); pos++) {
+      deallocateListTree(disk_info, list, buffer[pos], depth - 1);
     }
   }
 
-  deallocateBlock(disk_info, block_no);
+  deallocateListBlock(disk_info, list, block_no);
+}
+
+/**
+ * @brief Orders block numbers
+ *
+ * @param left
+ * @param right
+ * @return int
+ */
+int deallocateCompareBlocks(const void* left, const void* right) {
+  int64_t left_block  = *(int64_t*)left;
+  int64_t right_block = *(int64_t*)right;
+
+  return (left_block > right_block) - (left_block < right_block);
 }
 
 /**
- * @brief Gets rid of a triple indirect block
+ * @brief Frees the runs of a sorted list of blocks from start on, until at least limit blocks
+ * have been looked at. Each run of consecutive blocks in a group is zeroed with one ranged write
+ * and cleared from its bitmap in one go, instead of a write and a bitmap update per block.
+ * Windows preallocated right after a run go back as well.
  *
  * @param disk_info
- * @param block_no
+ * @param list Sorted
+ * @param start Position in the list to start at
+ * @param limit
+ * @return int64_t Position in the list to carry on from
  */
-void deallocateTripleIndirectBlock(DiskInfo* disk_info, int64_t block_no) {
-  int32_t buffer[disk_info->block_size / sizeof(int32_t)];
+int64_t deallocateBlockRuns(DiskInfo* disk_info, BlockList* list, int64_t start, int64_t limit) {
+  int64_t run_start = start;
 
-  if (block_no == 0) {
-    return;
-  }
+  for (int64_t run_end = start; run_start < list->count && run_start - start < limit;
+       run_start = run_end) {
+    int64_t first = list->blocks[run_start];
+    int64_t group = (first - 1) / disk_info->blocks_per_group;
+
+    // Extend the run while blocks follow on in the same group, skipping repeats
+    for (run_end = run_start + 1; run_end < list->count; run_end++) {
+      int64_t block_no = list->blocks[run_end];
+      int64_t last     = list->blocks[run_end - 1];
+
+      if ((block_no != last && block_no != last + 1) ||
+          (block_no - 1) / disk_info->blocks_per_group != group) {
+        break;
+      }
+    }
+
+    int64_t  count = list->blocks[run_end - 1] - first + 1;
+    BlockRun window;
+
+    if (disk_info->zero_freed) {
+      ioZeroBlocks(disk_info, first, count);
+    } else {
+      cacheDropBlocks(disk_info, first, count);
+    }
 
-  ioBlock(disk_info, block_no, (int8_t*)&buffer, IOMODE_READ);
+    deallocateBlockRange(disk_info, first, count);
 
-  for (int32_t pos = 0; pos < disk_info->block_size / sizeof(int32_t); pos++) {
-    if (buffer[pos] != 0) {
-      deallocateDoubleIndirectBlock(disk_info, buffer[pos]);
+    // The file won't grow into its window any more
+    if (cacheTakeWindow(disk_info, first + count, &window)) {
+      deallocateBlockRange(disk_info, window.next, window.left);
     }
   }
 
-  deallocateBlock(disk_info, block_no);
+  return run_start;
+}
+
+/**
+ * @brief Frees a list of blocks in block order, a run at a time
+ *
+ * @param disk_info
+ * @param list Emptied
+ */
+void deallocateBlockList(DiskInfo* disk_info, BlockList* list) {
+  qsort(list->blocks, list->count, sizeof(int64_t), deallocateCompareBlocks);
+  deallocateBlockRuns(disk_info, list, 0, list->count);
+
+  list->count = 0;
 }
 
 /**
@@ -417,45 +899,61 @@ void deallocateTripleIndirectBlock(DiskInfo* disk_info, int64_t block_no) {
  * @return int32_t
  */
 void deallocateINode(DiskInfo* disk_info, int32_t inode_no) {
-  GroupDesc group_desc;
-  INode     inode;
-  int8_t    buffer[disk_info->block_size];
+  INode inode;
 
-  int32_t group_no = inode_no / disk_info->inodes_per_group;
-  int32_t pos      = (inode_no % disk_info->inodes_per_group) / 8;
-  int8_t  bit      = pos % 8;
+  // INodes are numbered from 1
+  int32_t group_no = (inode_no - 1) / disk_info->inodes_per_group;
+  int32_t bit      = (inode_no - 1) % disk_info->inodes_per_group;
 
   ioINode(disk_info, &inode, inode_no, IOMODE_READ);
 
-  IndirectRange range = calculateIndirectRange(disk_info);
+  // Directories are counted per group so new ones can be spread out
+  if ((inode.i_mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+    GroupDesc group_desc;
 
-  // Kill all of the data blocks
-  for (int64_t block_pos = 0; block_pos < inode.i_blocks; block_pos++) {
-    int32_t block_no = 0;
-    ioFileBlockHelper(disk_info, &block_no, &inode, &range, block_pos);
+    cacheLockGroup(disk_info, group_no);
+    ioGroupDescriptor(disk_info, &group_desc, group_no, IOMODE_READ);
 
-    deallocateBlock(disk_info, block_no);
+    if (group_desc.bg_used_dirs_count > 0) {
+      group_desc.bg_used_dirs_count--;
+      ioGroupDescriptor(disk_info, &group_desc, group_no, IOMODE_WRITE);
+    }
+
+    cacheUnlockGroup(disk_info, group_no);
+  }
+
+  // Gather every data and indirect block, then free them in block order
+  BlockList list = { NULL, 0, 0 };
+
+  for (int32_t pos = 0; pos < EXT2_INDIRECT_SINGLE; pos++) {
+    deallocateListTree(disk_info, &list, inode.i_block[pos], 0);
   }
 
-  // Kill the indirect blocks if they exist
-  deallocateBlock(disk_info, inode.i_block[EXT2_INDIRECT_SINGLE]);
-  deallocateDoubleIndirectBlock(disk_info, inode.i_block[EXT2_INDIRECT_DOUBLE]);
-  deallocateTripleIndirectBlock(disk_info, inode.i_block[EXT2_INDIRECT_TRIPLE]);
+  deallocateListTree(disk_info, &list, inode.i_block[EXT2_INDIRECT_SINGLE], 1);
+  deallocateListTree(disk_info, &list, inode.i_block[EXT2_INDIRECT_DOUBLE], 2);
+  deallocateListTree(disk_info, &list, inode.i_block[EXT2_INDIRECT_TRIPLE], 3);
+
+  deallocateBlockList(disk_info, &list);
+  free(list.blocks);
 
   // Dump 0's to the block we're deallocing
   bzero(&inode, sizeof(INode));
   ioINode(disk_info, &inode, inode_no, IOMODE_WRITE);
 
-  // Read the group desc and find the right block
-  ioGroupDescriptor(disk_info, &group_desc, group_no, IOMODE_READ);
-  ioBlock(disk_info, group_desc.bg_inode_bitmap, (int8_t*)&buffer, IOMODE_READ);
+  // If this was a directory, nothing cached inside it is valid once the INode is reused
+  cacheInvalidateDentries(disk_info, inode_no);
+
+  cacheLockGroup(disk_info, group_no);
+
+  int8_t* bitmap = cacheLoadBitmap(disk_info, group_no, BITMAP_INODE);
 
-  // Flip the offending bit
-  buffer[pos] &= ~(1 << (bit - 1));
+  if (bitmap != NULL && testBit(bitmap[bit / 8], bit % 8)) {
+    // Flip the offending bit
+    bitmap[bit / 8] &= ~(1 << (bit % 8));
+    cacheMarkBitmap(disk_info, group_no, BITMAP_INODE, -1);
+  }
 
-  // Dump the bitmap back down to the disk
-  ioBlock(disk_info, group_desc.bg_inode_bitmap, (int8_t*)&buffer, IOMODE_WRITE);
-  disk_info->free_inodes++;
+  cacheUnlockGroup(disk_info, group_no);
 }
 
 /**
@@ -466,8 +964,11 @@ void deallocateINode(DiskInfo* disk_info, int32_t inode_no) {
  * @param new_dir
  */
 void allocateDirectoryTable(State* state, Directory* parent_dir, Directory* new_dir) {
-  int32_t inode_no = allocateINode(state);
-  int32_t block_no = allocateBlock(state->disk_info);
+  int32_t inode_no = allocateINode(state, parent_dir->inode, 1);
+
+  // The directory's first block goes in its own group
+  int32_t block_no =
+    allocateBlock(state->disk_info, allocateGoal(state->disk_info, NULL, inode_no, 0));
 
   // Create the INode and dump it to the disk
   INode inode;
@@ -489,16 +990,18 @@ void allocateDirectoryTable(State* state, Directory* parent_dir, Directory* new_
 
   new_dir->inode = inode_no;
 
-  // Add . .. and end dirs
-  Directory dirs[] = { { inode_no, 0, 1, EXT2_FT_DIR, "." },
-                       { parent_dir->inode, 0, 2, EXT2_FT_DIR, ".." },
-                       { 0, 0, 0, EXT2_FT_UNKNOWN, "\0" } };
+  // Add . and .., with .. holding the rest of the block
+  int8_t    buffer[state->disk_info->block_size];
+  Directory dirs[] = { { inode_no, 12, 1, EXT2_FT_DIR, "." },
+                       { parent_dir->inode, state->disk_info->block_size - 12, 2, EXT2_FT_DIR,
+                         ".." } };
 
-  for (int32_t pos = 0, offset = 0; pos < sizeof(dirs) / sizeof(Directory); pos++) {
-    if (offset % 4 != 0) {
-      offset += 4 - (offset % 4);
-    }
+  bzero(buffer, state->disk_info->block_size);
 
-    offset += ioDirectoryEntry(state->disk_info, &dirs[pos], &inode, offset, IOMODE_WRITE);
+  for (int32_t pos = 0, offset = 0; pos < sizeof(dirs) / sizeof(Directory); pos++) {
+    memcpy(buffer + offset, &dirs[pos], 8 + dirs[pos].name_len);
+    offset += dirs[pos].rec_len;
   }
-}
\ No newline at end of file
+
+  ioBlock(state->disk_info, block_no, buffer, IOMODE_WRITE);
+}
@@ -1,6 +1,7 @@
 #ifndef ALLOC_H
 #define ALLOC_H
 
+#include "htree.h"
 #include "io.h"
 #include "types.h"
 #include "utility.h"
@@ -8,7 +9,7 @@
 #include <time.h>
 
 /**
- * @brief Allocates a new directory entry
+ * @brief Allocates a new directory entry, with the directory locked
  *
  * @param disk_info
  * @param inode_start
@@ -17,37 +18,129 @@
 void allocateDirectoryEntry(DiskInfo* disk_info, int32_t inode_start, Directory* directory);
 
 /**
- * @brief Returns 1 if is end dir
+ * @brief Places a directory entry in the free space of a directory block
  *
+ * @param disk_info
+ * @param block
  * @param directory
- * @return int
+ * @return int32_t EXIT_FAILURE if the block has no room
  */
-int32_t isEndDirectory(Directory* directory);
+int32_t allocateDirectorySlot(DiskInfo* disk_info, int8_t* block, Directory* directory);
+
+/**
+ * @brief Adds an empty block to the end of a directory
+ *
+ * @param disk_info
+ * @param inode
+ * @return int64_t Position of the new block within the directory
+ */
+int64_t allocateDirectoryBlock(DiskInfo* disk_info, INode* inode);
+
+/**
+ * @brief Picks the group a new INode should go in. Directories made in the root are spread across
+ * the emptiest groups, everything else stays near its parent directory.
+ *
+ * @param disk_info
+ * @param parent_no INode of the directory the new INode goes in
+ * @param is_directory
+ * @return int64_t
+ */
+int64_t allocateINodeGroup(DiskInfo* disk_info, int64_t parent_no, int8_t is_directory);
 
 /**
  * @brief Allocates an INode
  *
  * @param state
+ * @param parent_no INode of the directory the new INode goes in
+ * @param is_directory
  * @return int32_t
  */
-int32_t allocateINode(State* state);
+int32_t allocateINode(State* state, int64_t parent_no, int8_t is_directory);
 
 /**
  * @brief Allocates a block
  *
  * @param disk_info
+ * @param goal Block to try first, 0 for no preference
+ * @return int32_t
+ */
+int32_t allocateBlock(DiskInfo* disk_info, int64_t goal);
+
+/**
+ * @brief Picks the block an INode's next blocks should start from
+ *
+ * @param disk_info
+ * @param inode Only read when first_block > 0
+ * @param inode_no 0 if unknown
+ * @param first_block
+ * @return int64_t 0 for no preference
+ */
+int64_t allocateGoal(DiskInfo* disk_info, INode* inode, int64_t inode_no, int64_t first_block);
+
+/**
+ * @brief Marks a run of blocks as used if all of them are still free. The group must be locked.
+ *
+ * @param disk_info
+ * @param group
+ * @param first_bit
+ * @param length
+ * @return int8_t 1 if the run was claimed
+ */
+int8_t allocateClaimRun(DiskInfo* disk_info, int64_t group, int64_t first_bit, int64_t length);
+
+/**
+ * @brief Claims a run of physically consecutive blocks in one pass over a group's bitmap
+ *
+ * @param disk_info
+ * @param goal Block the run should start at if it can, 0 for no preference
+ * @param count Blocks wanted
+ * @param allocated Set to the number of blocks claimed, which may be less than count
+ * @return int64_t First block of the run, -1 if the disk is full
+ */
+int64_t allocateBlockRange(DiskInfo* disk_info, int64_t goal, int64_t count, int64_t* allocated);
+
+/**
+ * @brief Hands out the next block of a run, claiming a new run once it is used up
+ *
+ * @param disk_info
+ * @param run
+ * @param wanted Blocks still needed
+ * @param is_indirect Zero the block
  * @return int32_t
  */
-int32_t allocateBlock(DiskInfo* disk_info);
+int32_t allocateRunBlock(DiskInfo* disk_info, BlockRun* run, int64_t wanted, int8_t is_indirect);
 
 /**
- * @brief Loads an INode up with all the blocks it'll need
+ * @brief Gives back claimed blocks that were never used
+ *
+ * @param disk_info
+ * @param block_no
+ * @param count
+ */
+void deallocateBlockRange(DiskInfo* disk_info, int64_t block_no, int64_t count);
+
+/**
+ * @brief Blocks a file of data_blocks may take once its indirect blocks are counted, an upper
+ * bound to check for room with before anything is allocated
+ *
+ * @param disk_info
+ * @param data_blocks
+ * @return int64_t
+ */
+int64_t allocateBlocksNeeded(DiskInfo* disk_info, int64_t data_blocks);
+
+/**
+ * @brief Loads an INode up with all the blocks it'll need, near the blocks it already has or
+ * else near the INode
  *
  * @param disk_info
  * @param inode
+ * @param inode_no 0 if unknown
+ * @param first_block First block that may still need allocating
  * @param blocks_count
  */
-void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count);
+void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t inode_no, int64_t first_block,
+                         int64_t blocks_count);
 
 /**
  * @brief Allocs a new dir table
@@ -59,7 +152,7 @@ void allocateINodeBlocks(DiskInfo* disk_info, INode* inode, int64_t blocks_count
 void allocateDirectoryTable(State* state, Directory* parent_dir, Directory* new_dir);
 
 /**
- * @brief Asks a dir entry to leave
+ * @brief Asks a dir entry to leave, with the directory locked
  *
  * @param disk_info
  * @param inode_no
@@ -75,6 +168,45 @@ void deallocateDirectoryEntry(DiskInfo* disk_info, int32_t inode_no, char* to_re
  */
 void deallocateBlock(DiskInfo* disk_info, int32_t block_no);
 
+/**
+ * @brief Adds a block and everything it points at to a list of blocks to free
+ *
+ * @param disk_info
+ * @param list
+ * @param block_no
+ * @param depth 0 for a data block, 1 for a single indirect block and so on
+ */
+void deallocateListTree(DiskInfo* disk_info, BlockList* list, int64_t block_no, int32_t depth);
+
+/**
+ * @brief Orders block numbers, for qsort()
+ *
+ * @param left
+ * @param right
+ * @return int
+ */
+int deallocateCompareBlocks(const void* left, const void* right);
+
+/**
+ * @brief Frees the runs of a sorted list of blocks from start on, until at least limit blocks
+ * have been looked at
+ *
+ * @param disk_info
+ * @param list Sorted
+ * @param start
+ * @param limit
+ * @return int64_t Position in the list to carry on from
+ */
+int64_t deallocateBlockRuns(DiskInfo* disk_info, BlockList* list, int64_t start, int64_t limit);
+
+/**
+ * @brief Frees a list of blocks a run at a time, in block order
+ *
+ * @param disk_info
+ * @param list Emptied
+ */
+void deallocateBlockList(DiskInfo* disk_info, BlockList* list);
+
 /**
  * @brief Deallocs an INode
  *
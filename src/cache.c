@@ -0,0 +1,1484 @@
+#include "cache.h"
+
+#include "io.h"
+
+/**
+ * @brief Hashes a block number into a bucket
+ *
+ * @param cache
+ * @param block
+ * @return int32_t
+ */
+int32_t cacheBucket(BlockCache* cache, int64_t block) {
+  return (uint64_t)(block * 0x9E3779B97F4A7C15ULL) >> 32 & (cache->bucket_count - 1);
+}
+
+/**
+ * @brief Gets the data held by a cache entry
+ *
+ * @param disk_info
+ * @param index
+ * @return int8_t*
+ */
+int8_t* cacheEntryData(DiskInfo* disk_info, int32_t index) {
+  return disk_info->block_cache->data + index * disk_info->block_size;
+}
+
+/**
+ * @brief Writes a cache entry back to the disk if it is dirty
+ *
+ * @param disk_info
+ * @param index
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheWriteBack(DiskInfo* disk_info, int32_t index) {
+  BlockCacheEntry* entry = &disk_info->block_cache->entries[index];
+
+  if (!entry->valid || !entry->dirty) {
+    return EXIT_SUCCESS;
+  }
+
+  if (ioBytes(disk_info, cacheEntryData(disk_info, index), disk_info->block_size,
+              entry->block * disk_info->block_size, IOMODE_WRITE) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  entry->dirty = 0;
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Finds the entry holding a block
+ *
+ * @param cache
+ * @param block
+ * @return int32_t index of the entry, or -1 on a miss
+ */
+int32_t cacheFind(BlockCache* cache, int64_t block) {
+  for (int32_t index = cache->buckets[cacheBucket(cache, block)]; index != -1;
+       index = cache->entries[index].next) {
+    if (cache->entries[index].block == block) {
+      return index;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Removes an entry from its hash bucket
+ *
+ * @param cache
+ * @param index
+ */
+void cacheUnlink(BlockCache* cache, int32_t index) {
+  int32_t* link = &cache->buckets[cacheBucket(cache, cache->entries[index].block)];
+
+  while (*link != index) {
+    link = &cache->entries[*link].next;
+  }
+
+  *link = cache->entries[index].next;
+}
+
+/**
+ * @brief Picks an entry to hold a new block, evicting with CLOCK when the cache is full
+ *
+ * @param disk_info
+ * @return int32_t index of the entry, or -1 if a dirty victim could not be written back
+ */
+int32_t cacheEvict(DiskInfo* disk_info) {
+  BlockCache* cache = disk_info->block_cache;
+
+  if (cache->used < cache->capacity) {
+    return cache->used++;
+  }
+
+  // Give every recently used entry a second chance before evicting it
+  while (cache->entries[cache->clock_hand].referenced) {
+    cache->entries[cache->clock_hand].referenced = 0;
+    cache->clock_hand                            = (cache->clock_hand + 1) % cache->capacity;
+  }
+
+  int32_t victim    = cache->clock_hand;
+  cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+
+  if (cacheWriteBack(disk_info, victim) == EXIT_FAILURE) {
+    return -1;
+  }
+
+  // Dropped entries and failed reads are already out of their buckets
+  if (cache->entries[victim].valid) {
+    cacheUnlink(cache, victim);
+  }
+
+  cache->entries[victim].valid = 0;
+
+  return victim;
+}
+
+/**
+ * @brief Gets the entry for a block, optionally reading its contents from the disk on a miss
+ *
+ * @param disk_info
+ * @param block
+ * @param load 1 to read the block from the disk on a miss
+ * @return int32_t index of the entry, or -1 on an IO error
+ */
+int32_t cacheGetEntry(DiskInfo* disk_info, int64_t block, int8_t load) {
+  BlockCache* cache = disk_info->block_cache;
+  int32_t     index = cacheFind(cache, block);
+
+  if (index != -1) {
+    cache->hits++;
+    cache->entries[index].referenced = 1;
+    return index;
+  }
+
+  cache->misses++;
+  index = cacheEvict(disk_info);
+
+  if (index == -1) {
+    return -1;
+  }
+
+  // A failed read leaves the entry invalid so it is handed out again on the next miss
+  if (load && ioBytes(disk_info, cacheEntryData(disk_info, index), disk_info->block_size,
+                      block * disk_info->block_size, IOMODE_READ) == EXIT_FAILURE) {
+    return -1;
+  }
+
+  BlockCacheEntry* entry  = &cache->entries[index];
+  int32_t          bucket = cacheBucket(cache, block);
+
+  entry->block      = block;
+  entry->valid      = 1;
+  entry->dirty      = 0;
+  entry->referenced = 1;
+  entry->next       = cache->buckets[bucket];
+
+  cache->buckets[bucket] = index;
+
+  return index;
+}
+
+/**
+ * @brief Sets up the block cache
+ *
+ * @param disk_info
+ * @param capacity
+ */
+void cacheInitialize(DiskInfo* disk_info, int32_t capacity) {
+  BlockCache* cache = (BlockCache*)calloc(1, sizeof(BlockCache));
+
+  cache->capacity     = capacity;
+  cache->bucket_count = 1;
+
+  // Keep the buckets a power of two so hashing is a mask
+  while (cache->bucket_count < capacity * 2) {
+    cache->bucket_count <<= 1;
+  }
+
+  cache->entries = (BlockCacheEntry*)calloc(capacity, sizeof(BlockCacheEntry));
+  cache->buckets = (int32_t*)malloc(cache->bucket_count * sizeof(int32_t));
+  cache->data    = (int8_t*)malloc(capacity * disk_info->block_size);
+
+  if (cache->entries == NULL || cache->buckets == NULL || cache->data == NULL) {
+    printf("cache: cacheInitialize(): error: Unable to allocate %d cache blocks\n", capacity);
+    exit(EXIT_FAILURE);
+  }
+
+  memset(cache->buckets, -1, cache->bucket_count * sizeof(int32_t));
+  pthread_mutex_init(&cache->lock, NULL);
+
+  disk_info->block_cache = cache;
+}
+
+/**
+ * @brief Copies data out of the cached copy of a block. The copy is made under the cache lock, so
+ * another thread evicting the entry can't change it halfway through.
+ *
+ * @param disk_info
+ * @param block
+ * @param buffer
+ * @param length
+ * @param offset
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheLoadBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, int64_t length,
+                       int64_t offset) {
+  pthread_mutex_lock(&disk_info->block_cache->lock);
+
+  int32_t index = cacheGetEntry(disk_info, block, 1);
+
+  if (index != -1) {
+    memcpy(buffer, cacheEntryData(disk_info, index) + offset, length);
+  }
+
+  pthread_mutex_unlock(&disk_info->block_cache->lock);
+
+  return index == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Copies data into the cached copy of a block and marks it dirty. A write covering the
+ * whole block skips reading the old contents.
+ *
+ * @param disk_info
+ * @param block
+ * @param buffer
+ * @param length
+ * @param offset
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheStoreBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, int64_t length,
+                        int64_t offset) {
+  int8_t whole_block = offset == 0 && length == disk_info->block_size;
+
+  pthread_mutex_lock(&disk_info->block_cache->lock);
+
+  int32_t index = cacheGetEntry(disk_info, block, !whole_block);
+
+  if (index != -1) {
+    memcpy(cacheEntryData(disk_info, index) + offset, buffer, length);
+    disk_info->block_cache->entries[index].dirty = 1;
+  }
+
+  pthread_mutex_unlock(&disk_info->block_cache->lock);
+
+  return index == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Orders cache entries by block number
+ *
+ * @param left
+ * @param right
+ * @return int
+ */
+int cacheCompareEntries(const void* left, const void* right) {
+  int64_t left_block  = ((BlockCacheEntry*)left)->block;
+  int64_t right_block = ((BlockCacheEntry*)right)->block;
+
+  return (left_block > right_block) - (left_block < right_block);
+}
+
+/**
+ * @brief Writes every dirty block back to the disk in block order. Runs of consecutive blocks
+ * are written with a single pwritev().
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheFlushBlocks(DiskInfo* disk_info) {
+  BlockCache* cache = disk_info->block_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  BlockCacheEntry dirty[cache->used];
+  struct iovec    vectors[cache->used];
+  int32_t         dirty_count = 0;
+  int32_t         status      = EXIT_SUCCESS;
+
+  // Borrow the next field to remember which entry each dirty block came from
+  for (int32_t index = 0; index < cache->used; index++) {
+    if (cache->entries[index].valid && cache->entries[index].dirty) {
+      dirty[dirty_count]        = cache->entries[index];
+      dirty[dirty_count++].next = index;
+    }
+  }
+
+  qsort(dirty, dirty_count, sizeof(BlockCacheEntry), cacheCompareEntries);
+
+  for (int32_t run_start = 0, run_end = 0; run_start < dirty_count; run_start = run_end) {
+    for (run_end = run_start; run_end < dirty_count &&
+                              dirty[run_end].block == dirty[run_start].block + run_end - run_start;
+         run_end++) {
+      vectors[run_end - run_start].iov_base = cacheEntryData(disk_info, dirty[run_end].next);
+      vectors[run_end - run_start].iov_len  = disk_info->block_size;
+    }
+
+    if (ioBytesVector(disk_info, vectors, run_end - run_start,
+                      dirty[run_start].block * disk_info->block_size,
+                      IOMODE_WRITE) == EXIT_FAILURE) {
+      // Leave the run dirty so the next flush tries again
+      status = EXIT_FAILURE;
+      continue;
+    }
+
+    for (int32_t pos = run_start; pos < run_end; pos++) {
+      cache->entries[dirty[pos].next].dirty = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  return status;
+}
+
+/**
+ * @brief Moves a run of blocks directly between a buffer and the disk. The cache stays locked
+ * from the transfer until its copies are fixed up, so a flush can't write a stale dirty block
+ * over the run in between or evict one before a read picks it up. A read takes the dirty cached
+ * blocks over what came off the disk, a write refreshes the cached copies and marks them clean.
+ *
+ * @param disk_info
+ * @param buffer Data of the whole run
+ * @param block First block of the run
+ * @param count
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheBlockRun(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t count,
+                      IOMode mode) {
+  BlockCache* cache = disk_info->block_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  if (ioBytes(disk_info, buffer, count * disk_info->block_size, block * disk_info->block_size,
+              mode) == EXIT_FAILURE) {
+    pthread_mutex_unlock(&cache->lock);
+    return EXIT_FAILURE;
+  }
+
+  for (int32_t index = 0; index < cache->used; index++) {
+    BlockCacheEntry* entry = &cache->entries[index];
+
+    if (!entry->valid || entry->block < block || entry->block >= block + count) {
+      continue;
+    }
+
+    int8_t* data = buffer + (entry->block - block) * disk_info->block_size;
+
+    if (mode == IOMODE_READ) {
+      if (entry->dirty) {
+        memcpy(data, cacheEntryData(disk_info, index), disk_info->block_size);
+      }
+    } else {
+      memcpy(cacheEntryData(disk_info, index), data, disk_info->block_size);
+      entry->dirty = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  if (mode == IOMODE_WRITE) {
+    cacheInvalidateBlockMapRange(disk_info, block, count);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Forgets the cached copies of a run of blocks about to be changed on the disk without
+ * going through a buffer. Dropping them first keeps a flush from writing a stale dirty copy over
+ * the new data.
+ *
+ * @param disk_info
+ * @param block First block of the run
+ * @param count
+ */
+void cacheDropBlocks(DiskInfo* disk_info, int64_t block, int64_t count) {
+  BlockCache* cache = disk_info->block_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (int32_t index = 0; index < cache->used; index++) {
+    BlockCacheEntry* entry = &cache->entries[index];
+
+    if (entry->valid && entry->block >= block && entry->block < block + count) {
+      cacheUnlink(cache, index);
+      entry->valid = 0;
+      entry->dirty = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+  cacheInvalidateBlockMapRange(disk_info, block, count);
+}
+
+/**
+ * @brief Finds the entry holding an INode
+ *
+ * @param cache
+ * @param inode_no
+ * @return int32_t index of the entry, or -1 on a miss
+ */
+int32_t cacheFindINode(INodeCache* cache, int64_t inode_no) {
+  for (int32_t index = cache->buckets[inode_no & (cache->bucket_count - 1)]; index != -1;
+       index = cache->entries[index].next) {
+    if (cache->entries[index].inode_no == inode_no) {
+      return index;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Picks an entry to hold a new INode, evicting an unpinned INode with CLOCK when full
+ *
+ * @param disk_info
+ * @return int32_t index of the entry, or -1 if nothing could be evicted
+ */
+int32_t cacheEvictINode(DiskInfo* disk_info) {
+  INodeCache* cache = disk_info->inode_cache;
+
+  if (cache->used < cache->capacity) {
+    return cache->used++;
+  }
+
+  // Two full sweeps clear every reference bit, so after that only pins keep entries alive
+  for (int32_t step = 0; step < cache->capacity * 2; step++) {
+    INodeCacheEntry* entry = &cache->entries[cache->clock_hand];
+    int32_t          index = cache->clock_hand;
+
+    cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+
+    if (entry->pins > 0) {
+      continue;
+    }
+
+    if (entry->referenced) {
+      entry->referenced = 0;
+      continue;
+    }
+
+    // Failed reads leave a slot that is on no chain and holds nothing to write back
+    if (entry->valid) {
+      if (entry->dirty &&
+          ioINodeTable(disk_info, &entry->inode, entry->inode_no, IOMODE_WRITE) == EXIT_FAILURE) {
+        return -1;
+      }
+
+      int32_t* link = &cache->buckets[entry->inode_no & (cache->bucket_count - 1)];
+
+      while (*link != index) {
+        link = &cache->entries[*link].next;
+      }
+
+      *link = entry->next;
+    }
+
+    entry->valid = 0;
+    entry->dirty = 0;
+
+    return index;
+  }
+
+  printf("cache: cacheEvictINode(): error: Every cached INode is pinned\n");
+  return -1;
+}
+
+/**
+ * @brief Gets the entry for an INode, reading it from its INode table on a miss
+ *
+ * @param disk_info
+ * @param inode_no
+ * @return int32_t index of the entry, or -1 on an IO error
+ */
+int32_t cacheGetINodeEntry(DiskInfo* disk_info, int64_t inode_no) {
+  INodeCache* cache = disk_info->inode_cache;
+  int32_t     index = cacheFindINode(cache, inode_no);
+
+  if (index != -1) {
+    cache->hits++;
+    cache->entries[index].referenced = 1;
+    return index;
+  }
+
+  cache->misses++;
+  index = cacheEvictINode(disk_info);
+
+  if (index == -1) {
+    return -1;
+  }
+
+  INodeCacheEntry* entry  = &cache->entries[index];
+  int32_t          bucket = inode_no & (cache->bucket_count - 1);
+
+  if (ioINodeTable(disk_info, &entry->inode, inode_no, IOMODE_READ) == EXIT_FAILURE) {
+    entry->valid = 0;
+    entry->dirty = 0;
+    return -1;
+  }
+
+  entry->inode_no   = inode_no;
+  entry->pins       = 0;
+  entry->valid      = 1;
+  entry->dirty      = 0;
+  entry->referenced = 1;
+  entry->next       = cache->buckets[bucket];
+
+  cache->buckets[bucket] = index;
+
+  return index;
+}
+
+/**
+ * @brief Sets up the INode cache
+ *
+ * @param disk_info
+ * @param capacity
+ */
+void cacheInitializeINodes(DiskInfo* disk_info, int32_t capacity) {
+  INodeCache* cache = (INodeCache*)calloc(1, sizeof(INodeCache));
+
+  cache->capacity     = capacity;
+  cache->bucket_count = 1;
+
+  while (cache->bucket_count < capacity * 2) {
+    cache->bucket_count <<= 1;
+  }
+
+  cache->entries     = (INodeCacheEntry*)calloc(capacity, sizeof(INodeCacheEntry));
+  cache->buckets     = (int32_t*)malloc(cache->bucket_count * sizeof(int32_t));
+  cache->inode_locks = (pthread_mutex_t**)calloc(disk_info->inode_count + 1, sizeof(void*));
+
+  if (cache->entries == NULL || cache->buckets == NULL || cache->inode_locks == NULL) {
+    printf("cache: cacheInitializeINodes(): error: Unable to allocate %d cache INodes\n",
+           capacity);
+    exit(EXIT_FAILURE);
+  }
+
+  memset(cache->buckets, -1, cache->bucket_count * sizeof(int32_t));
+  pthread_mutex_init(&cache->lock, NULL);
+
+  disk_info->inode_cache = cache;
+}
+
+/**
+ * @brief Copies an INode out of the cache
+ *
+ * @param disk_info
+ * @param inode
+ * @param inode_no
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheLoadINode(DiskInfo* disk_info, INode* inode, int64_t inode_no) {
+  pthread_mutex_lock(&disk_info->inode_cache->lock);
+
+  int32_t index = cacheGetINodeEntry(disk_info, inode_no);
+
+  if (index != -1) {
+    memcpy(inode, &disk_info->inode_cache->entries[index].inode, sizeof(INode));
+  }
+
+  pthread_mutex_unlock(&disk_info->inode_cache->lock);
+
+  return index == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Copies an INode into the cache and marks it dirty
+ *
+ * @param disk_info
+ * @param inode
+ * @param inode_no
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheStoreINode(DiskInfo* disk_info, INode* inode, int64_t inode_no) {
+  pthread_mutex_lock(&disk_info->inode_cache->lock);
+
+  int32_t index = cacheGetINodeEntry(disk_info, inode_no);
+
+  if (index != -1) {
+    memcpy(&disk_info->inode_cache->entries[index].inode, inode, sizeof(INode));
+    disk_info->inode_cache->entries[index].dirty = 1;
+  }
+
+  pthread_mutex_unlock(&disk_info->inode_cache->lock);
+
+  return index == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @brief Keeps an INode in the cache until it is unpinned
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cachePinINode(DiskInfo* disk_info, int64_t inode_no) {
+  pthread_mutex_lock(&disk_info->inode_cache->lock);
+
+  int32_t index = cacheGetINodeEntry(disk_info, inode_no);
+
+  if (index != -1) {
+    disk_info->inode_cache->entries[index].pins++;
+  }
+
+  pthread_mutex_unlock(&disk_info->inode_cache->lock);
+}
+
+/**
+ * @brief Lets a pinned INode be evicted again
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cacheUnpinINode(DiskInfo* disk_info, int64_t inode_no) {
+  pthread_mutex_lock(&disk_info->inode_cache->lock);
+
+  int32_t index = cacheFindINode(disk_info->inode_cache, inode_no);
+
+  if (index != -1 && disk_info->inode_cache->entries[index].pins > 0) {
+    disk_info->inode_cache->entries[index].pins--;
+  }
+
+  pthread_mutex_unlock(&disk_info->inode_cache->lock);
+}
+
+/**
+ * @brief Gets the lock of an INode, making it the first time. Two threads making the same lock at
+ * once agree on whichever was installed first.
+ *
+ * @param disk_info
+ * @param inode_no
+ * @return pthread_mutex_t*
+ */
+pthread_mutex_t* cacheINodeLock(DiskInfo* disk_info, int64_t inode_no) {
+  pthread_mutex_t** slot = &disk_info->inode_cache->inode_locks[inode_no];
+  pthread_mutex_t*  lock = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+  if (lock != NULL) {
+    return lock;
+  }
+
+  pthread_mutexattr_t attributes;
+  pthread_mutex_t*    expected = NULL;
+
+  lock = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
+
+  if (lock == NULL) {
+    printf("cache: cacheINodeLock(): error: Unable to allocate a lock for INode %ld\n", inode_no);
+    exit(EXIT_FAILURE);
+  }
+
+  // Lookups inside a directory lock it again while the caller already holds it
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(lock, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+
+  if (!__atomic_compare_exchange_n(slot, &expected, lock, 0, __ATOMIC_ACQ_REL,
+                                   __ATOMIC_ACQUIRE)) {
+    pthread_mutex_destroy(lock);
+    free(lock);
+    lock = expected;
+  }
+
+  return lock;
+}
+
+/**
+ * @brief Locks an INode against other writers of the same file or directory
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cacheLockINode(DiskInfo* disk_info, int64_t inode_no) {
+  if (inode_no < 1 || inode_no > disk_info->inode_count) {
+    return;
+  }
+
+  pthread_mutex_lock(cacheINodeLock(disk_info, inode_no));
+}
+
+/**
+ * @brief Unlocks an INode locked with cacheLockINode()
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cacheUnlockINode(DiskInfo* disk_info, int64_t inode_no) {
+  if (inode_no < 1 || inode_no > disk_info->inode_count) {
+    return;
+  }
+
+  pthread_mutex_unlock(cacheINodeLock(disk_info, inode_no));
+}
+
+/**
+ * @brief Orders cached INodes by INode number
+ *
+ * @param left
+ * @param right
+ * @return int
+ */
+int cacheCompareINodes(const void* left, const void* right) {
+  int64_t left_no  = ((INodeCacheEntry*)left)->inode_no;
+  int64_t right_no = ((INodeCacheEntry*)right)->inode_no;
+
+  return (left_no > right_no) - (left_no < right_no);
+}
+
+/**
+ * @brief Writes every dirty INode back to its INode table. INodes are written in order so
+ * neighbours land in the same cached table block before the blocks are flushed.
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheFlushINodes(DiskInfo* disk_info) {
+  INodeCache* cache = disk_info->inode_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  INodeCacheEntry dirty[cache->used];
+  int32_t         dirty_count = 0;
+  int32_t         status      = EXIT_SUCCESS;
+
+  // Borrow the next field to remember which entry each dirty INode came from
+  for (int32_t index = 0; index < cache->used; index++) {
+    if (cache->entries[index].valid && cache->entries[index].dirty) {
+      dirty[dirty_count]        = cache->entries[index];
+      dirty[dirty_count++].next = index;
+    }
+  }
+
+  qsort(dirty, dirty_count, sizeof(INodeCacheEntry), cacheCompareINodes);
+
+  for (int32_t pos = 0; pos < dirty_count; pos++) {
+    if (ioINodeTable(disk_info, &dirty[pos].inode, dirty[pos].inode_no, IOMODE_WRITE) ==
+        EXIT_FAILURE) {
+      status = EXIT_FAILURE;
+      continue;
+    }
+
+    cache->entries[dirty[pos].next].dirty = 0;
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  return status;
+}
+
+/**
+ * @brief Hashes a directory lookup into a bucket
+ *
+ * @param cache
+ * @param parent
+ * @param name
+ * @return int32_t
+ */
+int32_t cacheDentryBucket(DentryCache* cache, int64_t parent, char* name) {
+  uint64_t hash = 0xCBF29CE484222325ULL ^ (uint64_t)parent;
+
+  // FNV-1a over the name, seeded with the parent INode
+  for (char* current = name; *current != '\0'; current++) {
+    hash = (hash ^ (uint8_t)*current) * 0x100000001B3ULL;
+  }
+
+  return hash & (cache->bucket_count - 1);
+}
+
+/**
+ * @brief Finds the entry holding a directory lookup
+ *
+ * @param cache
+ * @param parent
+ * @param name
+ * @return int32_t index of the entry, or -1 on a miss
+ */
+int32_t cacheFindDentry(DentryCache* cache, int64_t parent, char* name) {
+  for (int32_t index = cache->buckets[cacheDentryBucket(cache, parent, name)]; index != -1;
+       index = cache->entries[index].next) {
+    if (cache->entries[index].parent == parent && strcmp(cache->entries[index].name, name) == 0) {
+      return index;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Removes a directory lookup from the cache
+ *
+ * @param cache
+ * @param index
+ */
+void cacheRemoveDentry(DentryCache* cache, int32_t index) {
+  DentryCacheEntry* entry = &cache->entries[index];
+  int32_t*          link  = &cache->buckets[cacheDentryBucket(cache, entry->parent, entry->name)];
+
+  while (*link != index) {
+    link = &cache->entries[*link].next;
+  }
+
+  *link        = entry->next;
+  entry->valid = 0;
+}
+
+/**
+ * @brief Sets up the directory entry cache
+ *
+ * @param disk_info
+ * @param capacity
+ */
+void cacheInitializeDentries(DiskInfo* disk_info, int32_t capacity) {
+  DentryCache* cache = (DentryCache*)calloc(1, sizeof(DentryCache));
+
+  cache->capacity     = capacity;
+  cache->bucket_count = 1;
+
+  while (cache->bucket_count < capacity * 2) {
+    cache->bucket_count <<= 1;
+  }
+
+  cache->entries = (DentryCacheEntry*)calloc(capacity, sizeof(DentryCacheEntry));
+  cache->buckets = (int32_t*)malloc(cache->bucket_count * sizeof(int32_t));
+
+  if (cache->entries == NULL || cache->buckets == NULL) {
+    printf("cache: cacheInitializeDentries(): error: Unable to allocate %d cache entries\n",
+           capacity);
+    exit(EXIT_FAILURE);
+  }
+
+  memset(cache->buckets, -1, cache->bucket_count * sizeof(int32_t));
+  pthread_mutex_init(&cache->lock, NULL);
+
+  disk_info->dentry_cache = cache;
+}
+
+/**
+ * @brief Looks up a name in a directory without touching the disk
+ *
+ * @param disk_info
+ * @param parent
+ * @param name
+ * @param found_file
+ * @return DentryLookup
+ */
+DentryLookup cacheLookupDentry(DiskInfo* disk_info, int64_t parent, char* name,
+                               Directory* found_file) {
+  DentryCache* cache = disk_info->dentry_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  int32_t      index  = cacheFindDentry(cache, parent, name);
+  DentryLookup lookup = DENTRY_MISS;
+
+  if (index == -1) {
+    cache->misses++;
+  } else if (cache->entries[index].inode == 0) {
+    cache->hits++;
+    cache->entries[index].referenced = 1;
+    lookup                           = DENTRY_NOT_FOUND;
+  } else {
+    DentryCacheEntry* entry = &cache->entries[index];
+
+    cache->hits++;
+    entry->referenced = 1;
+
+    bzero(found_file, sizeof(Directory));
+    found_file->inode     = entry->inode;
+    found_file->file_type = entry->file_type;
+    found_file->name_len  = entry->name_len;
+    found_file->rec_len   = 8 + entry->name_len;
+    strcpy(found_file->name, entry->name);
+
+    lookup = DENTRY_FOUND;
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  return lookup;
+}
+
+/**
+ * @brief Records the result of a directory lookup, replacing anything cached for the name
+ *
+ * @param disk_info
+ * @param parent
+ * @param name
+ * @param inode 0 if the name does not exist
+ * @param file_type
+ */
+void cacheStoreDentry(DiskInfo* disk_info, int64_t parent, char* name, int32_t inode,
+                      uint8_t file_type) {
+  DentryCache* cache = disk_info->dentry_cache;
+
+  if (strlen(name) >= EXT2_NAME_LEN) {
+    return;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+
+  int32_t index = cacheFindDentry(cache, parent, name);
+
+  if (index == -1 && cache->used < cache->capacity) {
+    index = cache->used++;
+  } else if (index == -1) {
+    while (cache->entries[cache->clock_hand].referenced) {
+      cache->entries[cache->clock_hand].referenced = 0;
+      cache->clock_hand                            = (cache->clock_hand + 1) % cache->capacity;
+    }
+
+    index             = cache->clock_hand;
+    cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+  }
+
+  if (cache->entries[index].valid) {
+    cacheRemoveDentry(cache, index);
+  }
+
+  DentryCacheEntry* entry  = &cache->entries[index];
+  int32_t           bucket = cacheDentryBucket(cache, parent, name);
+
+  entry->parent     = parent;
+  entry->inode      = inode;
+  entry->file_type  = file_type;
+  entry->name_len   = strlen(name);
+  entry->valid      = 1;
+  entry->referenced = 1;
+  entry->next       = cache->buckets[bucket];
+  strcpy(entry->name, name);
+
+  cache->buckets[bucket] = index;
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Forgets every lookup made inside a directory
+ *
+ * @param disk_info
+ * @param parent
+ */
+void cacheInvalidateDentries(DiskInfo* disk_info, int64_t parent) {
+  DentryCache* cache = disk_info->dentry_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (int32_t index = 0; index < cache->used; index++) {
+    if (cache->entries[index].valid && cache->entries[index].parent == parent) {
+      cacheRemoveDentry(cache, index);
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Gets the first of the two slots an indirect block can live in
+ *
+ * @param cache
+ * @param block
+ * @return int32_t
+ */
+int32_t cacheBlockMapSet(BlockMapCache* cache, int64_t block) {
+  return ((uint64_t)(block * 0x9E3779B97F4A7C15ULL) >> 32 & (cache->capacity / 2 - 1)) * 2;
+}
+
+/**
+ * @brief Sets up the block map cache
+ *
+ * @param disk_info
+ * @param capacity
+ */
+void cacheInitializeBlockMap(DiskInfo* disk_info, int32_t capacity) {
+  BlockMapCache* cache = (BlockMapCache*)calloc(1, sizeof(BlockMapCache));
+
+  cache->capacity = capacity;
+  cache->entries  = (BlockMapEntry*)calloc(capacity, sizeof(BlockMapEntry));
+  cache->pointers = (int32_t*)malloc(capacity * disk_info->block_size);
+
+  if (cache->entries == NULL || cache->pointers == NULL) {
+    printf("cache: cacheInitializeBlockMap(): error: Unable to allocate %d cache blocks\n",
+           capacity);
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_mutex_init(&cache->lock, NULL);
+
+  disk_info->block_map_cache = cache;
+}
+
+/**
+ * @brief Finds the slot holding an indirect block's block numbers. Of the two slots it can live
+ * in, a miss replaces the one used least recently. The cache lock must be held.
+ *
+ * @param disk_info
+ * @param block
+ * @return int32_t* NULL on an IO error
+ */
+int32_t* cacheGetBlockMap(DiskInfo* disk_info, int64_t block) {
+  BlockMapCache* cache   = disk_info->block_map_cache;
+  int32_t        set     = cacheBlockMapSet(cache, block);
+  int32_t        slot    = set;
+  int64_t        per_map = disk_info->block_size / sizeof(int32_t);
+
+  for (int32_t way = 0; way < 2; way++) {
+    BlockMapEntry* entry = &cache->entries[set + way];
+
+    if (entry->valid && entry->block == block) {
+      // Sets start on an even slot, so the other way of the set is slot ^ 1
+      entry->recent                          = 1;
+      cache->entries[(set + way) ^ 1].recent = 0;
+      cache->hits++;
+
+      return cache->pointers + (set + way) * per_map;
+    }
+
+    if (!entry->valid || !entry->recent) {
+      slot = set + way;
+    }
+  }
+
+  cache->misses++;
+
+  BlockMapEntry* entry    = &cache->entries[slot];
+  int32_t*       pointers = cache->pointers + slot * per_map;
+
+  entry->valid = 0;
+
+  if (ioBlock(disk_info, block, (int8_t*)pointers, IOMODE_READ) == EXIT_FAILURE) {
+    return NULL;
+  }
+
+  entry->block                    = block;
+  entry->valid                    = 1;
+  entry->recent                   = 1;
+  cache->entries[slot ^ 1].recent = 0;
+
+  return pointers;
+}
+
+/**
+ * @brief Reads one block number out of an indirect block through the cache
+ *
+ * @param disk_info
+ * @param block
+ * @param index
+ * @return int32_t 0 on an IO error
+ */
+int32_t cacheLoadBlockMap(DiskInfo* disk_info, int64_t block, int32_t index) {
+  pthread_mutex_lock(&disk_info->block_map_cache->lock);
+
+  int32_t* pointers = cacheGetBlockMap(disk_info, block);
+  int32_t  block_no = pointers == NULL ? 0 : pointers[index];
+
+  pthread_mutex_unlock(&disk_info->block_map_cache->lock);
+
+  return block_no;
+}
+
+/**
+ * @brief Forgets a decoded indirect block
+ *
+ * @param disk_info
+ * @param block
+ */
+void cacheInvalidateBlockMap(DiskInfo* disk_info, int64_t block) {
+  BlockMapCache* cache = disk_info->block_map_cache;
+  int32_t        set   = cacheBlockMapSet(cache, block);
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (int32_t way = 0; way < 2; way++) {
+    if (cache->entries[set + way].block == block) {
+      cache->entries[set + way].valid = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Forgets every decoded indirect block in a run of blocks
+ *
+ * @param disk_info
+ * @param block First block of the run
+ * @param count
+ */
+void cacheInvalidateBlockMapRange(DiskInfo* disk_info, int64_t block, int64_t count) {
+  BlockMapCache* cache = disk_info->block_map_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (int32_t slot = 0; slot < cache->capacity; slot++) {
+    if (cache->entries[slot].block >= block && cache->entries[slot].block < block + count) {
+      cache->entries[slot].valid = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Sets up the bitmap cache for a disk. Group count and block size must already be known.
+ *
+ * @param disk_info
+ * @param flush_interval in seconds
+ */
+void cacheInitializeBitmaps(DiskInfo* disk_info, int32_t flush_interval) {
+  BitmapCache* cache = (BitmapCache*)calloc(1, sizeof(BitmapCache));
+  int64_t      count = 2 * (int64_t)disk_info->group_count;
+
+  cache->bitmaps        = (int8_t*)malloc(count * disk_info->block_size);
+  cache->loaded         = (int8_t*)calloc(count, sizeof(int8_t));
+  cache->dirty          = (int8_t*)calloc(count, sizeof(int8_t));
+  cache->flush_interval = flush_interval;
+  cache->last_flush     = time(NULL);
+
+  cache->full_groups[BITMAP_BLOCK] = (int8_t*)calloc(disk_info->group_count / 8 + 8, 1);
+  cache->full_groups[BITMAP_INODE] = (int8_t*)calloc(disk_info->group_count / 8 + 8, 1);
+  cache->group_locks = (pthread_mutex_t*)calloc(disk_info->group_count, sizeof(pthread_mutex_t));
+
+  if (cache->bitmaps == NULL || cache->loaded == NULL || cache->dirty == NULL ||
+      cache->full_groups[BITMAP_BLOCK] == NULL || cache->full_groups[BITMAP_INODE] == NULL ||
+      cache->group_locks == NULL) {
+    printf("cache: cacheInitializeBitmaps(): error: Unable to allocate %ld bitmaps\n", count);
+    exit(EXIT_FAILURE);
+  }
+
+  for (int64_t group = 0; group < disk_info->group_count; group++) {
+    pthread_mutex_init(&cache->group_locks[group], NULL);
+  }
+
+  disk_info->bitmap_cache = cache;
+
+  // The group descriptors already know which groups are full
+  for (int64_t group = 0; group < disk_info->group_count; group++) {
+    cacheSetGroupFull(disk_info, group, BITMAP_BLOCK,
+                      disk_info->group_descs[group].bg_free_blocks_count == 0);
+    cacheSetGroupFull(disk_info, group, BITMAP_INODE,
+                      disk_info->group_descs[group].bg_free_inodes_count == 0);
+  }
+}
+
+/**
+ * @brief Finds the block a group keeps one of its bitmaps in
+ *
+ * @param disk_info
+ * @param group
+ * @param type
+ * @return int64_t
+ */
+int64_t cacheBitmapBlock(DiskInfo* disk_info, int64_t group, BitmapType type) {
+  GroupDesc* group_desc = &disk_info->group_descs[group];
+
+  return type == BITMAP_BLOCK ? group_desc->bg_block_bitmap : group_desc->bg_inode_bitmap;
+}
+
+/**
+ * @brief Locks a group so its bitmaps and descriptor can be changed
+ *
+ * @param disk_info
+ * @param group
+ */
+void cacheLockGroup(DiskInfo* disk_info, int64_t group) {
+  pthread_mutex_lock(&disk_info->bitmap_cache->group_locks[group]);
+}
+
+/**
+ * @brief Unlocks a group locked with cacheLockGroup()
+ *
+ * @param disk_info
+ * @param group
+ */
+void cacheUnlockGroup(DiskInfo* disk_info, int64_t group) {
+  pthread_mutex_unlock(&disk_info->bitmap_cache->group_locks[group]);
+}
+
+/**
+ * @brief Gets the in memory copy of a group's bitmap, reading it from the disk the first time
+ *
+ * @param disk_info
+ * @param group
+ * @param type
+ * @return int8_t* NULL on an IO error
+ */
+int8_t* cacheLoadBitmap(DiskInfo* disk_info, int64_t group, BitmapType type) {
+  BitmapCache* cache = disk_info->bitmap_cache;
+  int64_t      index = 2 * group + type;
+
+  if (group < 0 || group >= disk_info->group_count) {
+    printf("cache: cacheLoadBitmap(): error: Group %4ld does not exist\n", group);
+    return NULL;
+  }
+
+  int8_t* bitmap = cache->bitmaps + index * disk_info->block_size;
+
+  if (!cache->loaded[index]) {
+    if (ioBlock(disk_info, cacheBitmapBlock(disk_info, group, type), bitmap, IOMODE_READ) ==
+        EXIT_FAILURE) {
+      return NULL;
+    }
+
+    cache->loaded[index] = 1;
+  }
+
+  return bitmap;
+}
+
+/**
+ * @brief Marks a group's bitmap as changed, it is written back on the next bitmap flush. The
+ * group's free count, the disk's free count and the full group summary follow the change.
+ *
+ * @param disk_info
+ * @param group
+ * @param type
+ * @param claimed Bits set, negative for bits cleared
+ */
+void cacheMarkBitmap(DiskInfo* disk_info, int64_t group, BitmapType type, int32_t claimed) {
+  GroupDesc group_desc;
+  int64_t   free_count;
+
+  disk_info->bitmap_cache->dirty[2 * group + type] = 1;
+
+  if (claimed == 0) {
+    return;
+  }
+
+  ioGroupDescriptor(disk_info, &group_desc, group, IOMODE_READ);
+
+  if (type == BITMAP_BLOCK) {
+    free_count = (int64_t)group_desc.bg_free_blocks_count - claimed;
+    disk_info->free_blocks -= claimed;
+  } else {
+    free_count = (int64_t)group_desc.bg_free_inodes_count - claimed;
+    disk_info->free_inodes -= claimed;
+  }
+
+  // Counts left wrong by other tools must not wrap around
+  if (free_count < 0) {
+    free_count = 0;
+  }
+
+  if (type == BITMAP_BLOCK) {
+    group_desc.bg_free_blocks_count = free_count;
+  } else {
+    group_desc.bg_free_inodes_count = free_count;
+  }
+
+  ioGroupDescriptor(disk_info, &group_desc, group, IOMODE_WRITE);
+  cacheSetGroupFull(disk_info, group, type, free_count == 0);
+}
+
+/**
+ * @brief Records whether a group has anything free
+ *
+ * @param disk_info
+ * @param group
+ * @param type
+ * @param is_full
+ */
+void cacheSetGroupFull(DiskInfo* disk_info, int64_t group, BitmapType type, int8_t is_full) {
+  int8_t* summary = disk_info->bitmap_cache->full_groups[type];
+
+  // Groups sharing a byte of the summary are changed under different locks
+  if (is_full) {
+    __atomic_fetch_or(&summary[group / 8], 1 << (group % 8), __ATOMIC_RELAXED);
+  } else {
+    __atomic_fetch_and(&summary[group / 8], ~(1 << (group % 8)), __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * @brief Finds a group with something free, searching from start and wrapping around. The
+ * summary changes under other threads' group locks, so the search runs over a copy of it.
+ *
+ * @param disk_info
+ * @param type
+ * @param start
+ * @return int64_t -1 if every group is full
+ */
+int64_t cacheFindGroup(DiskInfo* disk_info, BitmapType type, int64_t start) {
+  int8_t* full_groups = disk_info->bitmap_cache->full_groups[type];
+  int64_t length      = disk_info->group_count / 8 + 8;
+  int8_t  summary[length];
+
+  for (int64_t pos = 0; pos < length; pos++) {
+    summary[pos] = __atomic_load_n(&full_groups[pos], __ATOMIC_RELAXED);
+  }
+
+  int64_t group = findFreeBit(summary, start, disk_info->group_count);
+
+  if (group == -1 && start > 0) {
+    group = findFreeBit(summary, 0, start);
+  }
+
+  return group;
+}
+
+/**
+ * @brief Writes every dirty bitmap back to its block
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheFlushBitmaps(DiskInfo* disk_info) {
+  BitmapCache* cache = disk_info->bitmap_cache;
+
+  for (int64_t index = 0; index < 2 * (int64_t)disk_info->group_count; index++) {
+    if (!cache->dirty[index]) {
+      continue;
+    }
+
+    // The bitmap must not change while it is copied out
+    cacheLockGroup(disk_info, index / 2);
+
+    int32_t status =
+      ioBlock(disk_info, cacheBitmapBlock(disk_info, index / 2, index % 2),
+              cache->bitmaps + index * disk_info->block_size, IOMODE_WRITE);
+
+    if (status == EXIT_SUCCESS) {
+      cache->dirty[index] = 0;
+      cache->writes++;
+    }
+
+    cacheUnlockGroup(disk_info, index / 2);
+
+    if (status == EXIT_FAILURE) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  cache->last_flush = time(NULL);
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Sets up the preallocation windows for a disk
+ *
+ * @param disk_info
+ * @param capacity in windows
+ */
+void cacheInitializePrealloc(DiskInfo* disk_info, int32_t capacity) {
+  PreallocCache* cache = (PreallocCache*)calloc(1, sizeof(PreallocCache));
+
+  cache->windows  = (BlockRun*)calloc(capacity, sizeof(BlockRun));
+  cache->capacity = capacity;
+
+  if (cache->windows == NULL) {
+    printf("cache: cacheInitializePrealloc(): error: Unable to allocate %d windows\n", capacity);
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_mutex_init(&cache->lock, NULL);
+
+  disk_info->prealloc_cache = cache;
+}
+
+/**
+ * @brief Clears a window's bits in its group's bitmap and empties the window
+ *
+ * @param disk_info
+ * @param window
+ */
+void cacheReleaseWindow(DiskInfo* disk_info, BlockRun* window) {
+  int64_t group = (window->next - 1) / disk_info->blocks_per_group;
+  int64_t first = (window->next - 1) % disk_info->blocks_per_group;
+  int32_t freed = 0;
+
+  cacheLockGroup(disk_info, group);
+
+  int8_t* bitmap = cacheLoadBitmap(disk_info, group, BITMAP_BLOCK);
+
+  if (bitmap != NULL) {
+    for (int64_t bit = first; bit < first + window->left; bit++) {
+      if (testBit(bitmap[bit / 8], bit % 8)) {
+        bitmap[bit / 8] &= ~(1 << (bit % 8));
+        freed++;
+      }
+    }
+
+    cacheMarkBitmap(disk_info, group, BITMAP_BLOCK, -freed);
+  }
+
+  cacheUnlockGroup(disk_info, group);
+
+  disk_info->prealloc_cache->reserved -= window->left;
+  window->left = 0;
+}
+
+/**
+ * @brief Takes the window that starts at a block out of the cache
+ *
+ * @param disk_info
+ * @param block
+ * @param run
+ * @return int8_t 1 if there was a window at block
+ */
+int8_t cacheTakeWindow(DiskInfo* disk_info, int64_t block, BlockRun* run) {
+  PreallocCache* cache = disk_info->prealloc_cache;
+  int8_t         found = 0;
+
+  if (block <= 0) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (int32_t slot = 0; slot < cache->capacity && !found; slot++) {
+    BlockRun* window = &cache->windows[slot];
+
+    if (window->left > 0 && window->next == block) {
+      *run = *window;
+      cache->reserved -= window->left;
+      cache->hits++;
+      window->left = 0;
+      found        = 1;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  return found;
+}
+
+/**
+ * @brief Keeps the unused end of a run as a window. With every slot in use, the slot under the
+ * hand is released and reused.
+ *
+ * @param disk_info
+ * @param run
+ */
+void cacheStoreWindow(DiskInfo* disk_info, BlockRun* run) {
+  PreallocCache* cache = disk_info->prealloc_cache;
+  BlockRun*      slot  = NULL;
+
+  if (run->left <= 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (int32_t index = 0; index < cache->capacity && slot == NULL; index++) {
+    if (cache->windows[index].left == 0) {
+      slot = &cache->windows[index];
+    }
+  }
+
+  if (slot == NULL) {
+    slot        = &cache->windows[cache->hand];
+    cache->hand = (cache->hand + 1) % cache->capacity;
+    cacheReleaseWindow(disk_info, slot);
+  }
+
+  *slot = *run;
+  cache->reserved += run->left;
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ * @brief Gives every window's blocks back to the bitmaps
+ *
+ * @param disk_info
+ */
+void cacheReleaseWindows(DiskInfo* disk_info) {
+  PreallocCache* cache = disk_info->prealloc_cache;
+
+  pthread_mutex_lock(&cache->lock);
+
+  for (int32_t slot = 0; slot < cache->capacity; slot++) {
+    if (cache->windows[slot].left > 0) {
+      cacheReleaseWindow(disk_info, &cache->windows[slot]);
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+}
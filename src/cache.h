@@ -0,0 +1,367 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Number of blocks the block cache holds
+ */
+#define BLOCK_CACHE_CAPACITY 1024
+
+/**
+ * @brief Number of INodes the INode cache holds
+ */
+#define INODE_CACHE_CAPACITY 512
+
+/**
+ * @brief Number of directory lookups the directory entry cache holds
+ */
+#define DENTRY_CACHE_CAPACITY 1024
+
+/**
+ * @brief Number of indirect blocks the block map cache holds, must be a power of two
+ */
+#define BLOCK_MAP_CACHE_CAPACITY 64
+
+/**
+ * @brief Seconds a changed bitmap may stay in memory before it is written back
+ */
+#define BITMAP_FLUSH_INTERVAL 5
+
+/**
+ * @brief Number of preallocation windows kept at once
+ */
+#define PREALLOC_CACHE_CAPACITY 32
+
+/**
+ * @brief Blocks claimed past the end of a growing file
+ */
+#define PREALLOC_WINDOW 8
+
+/**
+ * @brief Sets up the block cache for a disk. Block size must already be known.
+ *
+ * @param disk_info
+ * @param capacity in blocks
+ */
+void cacheInitialize(DiskInfo* disk_info, int32_t capacity);
+
+/**
+ * @brief Copies data out of the cached copy of a block, reading it from the disk on a miss
+ *
+ * @param disk_info
+ * @param block
+ * @param buffer
+ * @param length
+ * @param offset within the block
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheLoadBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, int64_t length,
+                       int64_t offset);
+
+/**
+ * @brief Copies data into the cached copy of a block and marks it dirty
+ *
+ * @param disk_info
+ * @param block
+ * @param buffer
+ * @param length
+ * @param offset within the block
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheStoreBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, int64_t length,
+                        int64_t offset);
+
+/**
+ * @brief Writes every dirty block back to the disk
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheFlushBlocks(DiskInfo* disk_info);
+
+/**
+ * @brief Moves a run of blocks directly between a buffer and the disk, keeping the cached copies
+ * in step. Dirty cached blocks win on a read, cached copies are refreshed on a write.
+ *
+ * @param disk_info
+ * @param buffer
+ * @param block
+ * @param count
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheBlockRun(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t count,
+                      IOMode mode);
+
+/**
+ * @brief Forgets cached blocks before a run of blocks is changed directly on the disk, e.g. by
+ * copy_file_range()
+ *
+ * @param disk_info
+ * @param block
+ * @param count
+ */
+void cacheDropBlocks(DiskInfo* disk_info, int64_t block, int64_t count);
+
+/**
+ * @brief Sets up the INode cache for a disk
+ *
+ * @param disk_info
+ * @param capacity in INodes
+ */
+void cacheInitializeINodes(DiskInfo* disk_info, int32_t capacity);
+
+/**
+ * @brief Copies an INode out of the cache, reading it from its INode table on a miss
+ *
+ * @param disk_info
+ * @param inode
+ * @param inode_no
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheLoadINode(DiskInfo* disk_info, INode* inode, int64_t inode_no);
+
+/**
+ * @brief Copies an INode into the cache and marks it dirty
+ *
+ * @param disk_info
+ * @param inode
+ * @param inode_no
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheStoreINode(DiskInfo* disk_info, INode* inode, int64_t inode_no);
+
+/**
+ * @brief Keeps an INode cached until a matching cacheUnpinINode()
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cachePinINode(DiskInfo* disk_info, int64_t inode_no);
+
+/**
+ * @brief Drops one pin from an INode
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cacheUnpinINode(DiskInfo* disk_info, int64_t inode_no);
+
+/**
+ * @brief Locks an INode against other threads changing the same file or directory. The lock is
+ * recursive, a thread may take it again while it holds it. Directories are locked before what is
+ * in them.
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cacheLockINode(DiskInfo* disk_info, int64_t inode_no);
+
+/**
+ * @brief Unlocks an INode locked with cacheLockINode()
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void cacheUnlockINode(DiskInfo* disk_info, int64_t inode_no);
+
+/**
+ * @brief Writes every dirty INode back to its INode table block
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheFlushINodes(DiskInfo* disk_info);
+
+/**
+ * @brief Sets up the directory entry cache for a disk
+ *
+ * @param disk_info
+ * @param capacity in entries
+ */
+void cacheInitializeDentries(DiskInfo* disk_info, int32_t capacity);
+
+/**
+ * @brief Looks up a name in a directory without touching the disk. found_file is only written
+ * when the name is cached as existing.
+ *
+ * @param disk_info
+ * @param parent INode of the directory
+ * @param name
+ * @param found_file
+ * @return DentryLookup
+ */
+DentryLookup cacheLookupDentry(DiskInfo* disk_info, int64_t parent, char* name,
+                               Directory* found_file);
+
+/**
+ * @brief Records the result of looking a name up in a directory
+ *
+ * @param disk_info
+ * @param parent INode of the directory
+ * @param name
+ * @param inode 0 to record that the name does not exist
+ * @param file_type
+ */
+void cacheStoreDentry(DiskInfo* disk_info, int64_t parent, char* name, int32_t inode,
+                      uint8_t file_type);
+
+/**
+ * @brief Forgets every cached lookup inside a directory
+ *
+ * @param disk_info
+ * @param parent INode of the directory
+ */
+void cacheInvalidateDentries(DiskInfo* disk_info, int64_t parent);
+
+/**
+ * @brief Sets up the block map cache for a disk. Block size must already be known.
+ *
+ * @param disk_info
+ * @param capacity in indirect blocks, a power of two
+ */
+void cacheInitializeBlockMap(DiskInfo* disk_info, int32_t capacity);
+
+/**
+ * @brief Reads one block number out of an indirect block, decoding the block on a miss
+ *
+ * @param disk_info
+ * @param block Indirect block
+ * @param index
+ * @return int32_t 0 on an IO error
+ */
+int32_t cacheLoadBlockMap(DiskInfo* disk_info, int64_t block, int32_t index);
+
+/**
+ * @brief Forgets a decoded indirect block, called whenever the block is written
+ *
+ * @param disk_info
+ * @param block
+ */
+void cacheInvalidateBlockMap(DiskInfo* disk_info, int64_t block);
+
+/**
+ * @brief Forgets every decoded indirect block in a run of blocks
+ *
+ * @param disk_info
+ * @param block First block of the run
+ * @param count
+ */
+void cacheInvalidateBlockMapRange(DiskInfo* disk_info, int64_t block, int64_t count);
+
+/**
+ * @brief Sets up the bitmap cache for a disk. The group descriptor table must already be loaded
+ * before a bitmap is used.
+ *
+ * @param disk_info
+ * @param flush_interval in seconds
+ */
+void cacheInitializeBitmaps(DiskInfo* disk_info, int32_t flush_interval);
+
+/**
+ * @brief Locks a group, its bitmaps and descriptor are only read or changed with the lock held
+ *
+ * @param disk_info
+ * @param group
+ */
+void cacheLockGroup(DiskInfo* disk_info, int64_t group);
+
+/**
+ * @brief Unlocks a group locked with cacheLockGroup()
+ *
+ * @param disk_info
+ * @param group
+ */
+void cacheUnlockGroup(DiskInfo* disk_info, int64_t group);
+
+/**
+ * @brief Gets a group's bitmap, reading it on first use. The group must be locked. The pointer
+ * stays valid, changes through it must be followed by cacheMarkBitmap().
+ *
+ * @param disk_info
+ * @param group
+ * @param type
+ * @return int8_t* NULL on an IO error
+ */
+int8_t* cacheLoadBitmap(DiskInfo* disk_info, int64_t group, BitmapType type);
+
+/**
+ * @brief Marks a group's bitmap as changed and keeps the free counts in step with it. The group
+ * must be locked.
+ *
+ * @param disk_info
+ * @param group
+ * @param type
+ * @param claimed Bits set, negative for bits cleared
+ */
+void cacheMarkBitmap(DiskInfo* disk_info, int64_t group, BitmapType type, int32_t claimed);
+
+/**
+ * @brief Records whether a group has anything free
+ *
+ * @param disk_info
+ * @param group
+ * @param type
+ * @param is_full
+ */
+void cacheSetGroupFull(DiskInfo* disk_info, int64_t group, BitmapType type, int8_t is_full);
+
+/**
+ * @brief Finds a group with something free without reading any bitmaps. Nothing is locked, so
+ * the group may be full by the time it is locked.
+ *
+ * @param disk_info
+ * @param type
+ * @param start Group to search from, the search wraps around
+ * @return int64_t -1 if every group is full
+ */
+int64_t cacheFindGroup(DiskInfo* disk_info, BitmapType type, int64_t start);
+
+/**
+ * @brief Writes every changed bitmap back to the disk
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t cacheFlushBitmaps(DiskInfo* disk_info);
+
+/**
+ * @brief Sets up the preallocation windows for a disk
+ *
+ * @param disk_info
+ * @param capacity in windows
+ */
+void cacheInitializePrealloc(DiskInfo* disk_info, int32_t capacity);
+
+/**
+ * @brief Takes the window that starts at a block out of the cache, its blocks stay claimed
+ *
+ * @param disk_info
+ * @param block First block of the window
+ * @param run Set to the window
+ * @return int8_t 1 if there was a window at block
+ */
+int8_t cacheTakeWindow(DiskInfo* disk_info, int64_t block, BlockRun* run);
+
+/**
+ * @brief Keeps the unused end of a run as a window, giving up the oldest window when they are
+ * all in use
+ *
+ * @param disk_info
+ * @param run Claimed blocks, the run must not cross groups
+ */
+void cacheStoreWindow(DiskInfo* disk_info, BlockRun* run);
+
+/**
+ * @brief Gives every window's blocks back to the bitmaps
+ *
+ * @param disk_info
+ */
+void cacheReleaseWindows(DiskInfo* disk_info);
+
+#endif
@@ -29,11 +29,7 @@ void runLS(State* state, char* parameter) {
  */
 void runMKDIR(State* state, char* parameter) {
   Directory parent_folder;
-
-  if (pathExists(state, parameter) == EXIT_SUCCESS) {
-    printf("mkdir: cannot create directory: '%s': File exists\n", parameter);
-    return;
-  }
+  Directory existing;
 
   if (findPathParent(state, &parent_folder, parameter) == EXIT_FAILURE) {
     printf("mkdir: cannot create directory: '%s': No such file or directory\n", parameter);
@@ -43,12 +39,23 @@ void runMKDIR(State* state, char* parameter) {
   Directory new_dir;
   getParameterStub(parameter, new_dir.name);
 
+  // Nobody else may add the name between the check and the new entry
+  cacheLockINode(state->disk_info, parent_folder.inode);
+
+  if (findEntry(state->disk_info, parent_folder.inode, new_dir.name, &existing) == EXIT_SUCCESS) {
+    printf("mkdir: cannot create directory: '%s': File exists\n", parameter);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
+    return;
+  }
+
   new_dir.name_len  = strlen(new_dir.name);
   new_dir.file_type = EXT2_FT_DIR;
   new_dir.rec_len   = 8 + strlen(new_dir.name);
 
   allocateDirectoryTable(state, &parent_folder, &new_dir);
   allocateDirectoryEntry(state->disk_info, parent_folder.inode, &new_dir);
+
+  cacheUnlockINode(state->disk_info, parent_folder.inode);
 }
 
 /**
@@ -75,53 +82,62 @@ void runRMDIR(State* state, char* parameter) {
     }
   }
 
-  // Check and see if the path exists
-  if (pathExists(state, parameter) == EXIT_FAILURE) {
+  if (findPathParent(state, &parent_folder, parameter) == EXIT_FAILURE) {
     printf("rmdir: %s: No such file or directory\n", parameter);
     return;
   }
 
-  // Load it if the path exists
-  findPath(state, &folder_to_remove, parameter);
-  findPathParent(state, &parent_folder, parameter);
+  // The parent is locked before the directory, and both stay locked until it is gone
+  cacheLockINode(state->disk_info, parent_folder.inode);
+
+  // Check and see if the path exists
+  if (findEntry(state->disk_info, parent_folder.inode, stub, &folder_to_remove) ==
+      EXIT_FAILURE) {
+    printf("rmdir: %s: No such file or directory\n", parameter);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
+    return;
+  }
 
   // Make sure we're removing a dir
   if (folder_to_remove.file_type != EXT2_FT_DIR) {
     printf("rmdir: %s: Not a directory\n", parameter);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
     return;
   }
 
-  // Make sure it's an empty dir
-  INode     first_item_inode;
-  Directory first_item;
-  int64_t   read_index = 0;
-  ioINode(state->disk_info, &first_item_inode, folder_to_remove.inode, IOMODE_READ);
+  cacheLockINode(state->disk_info, folder_to_remove.inode);
 
-  for (int pos = 0; pos < 2; pos++) {
-    read_index +=
-      ioDirectoryEntry(state->disk_info, &first_item, &first_item_inode, read_index, IOMODE_READ);
+  // Make sure it's an empty dir: anything besides . and .. is an entry
+  DirectoryIterator iterator;
+  Directory         item;
+  int8_t            is_empty = 1;
 
-    if (read_index % 4 != 0) {
-      read_index += 4 - (read_index % 4);
+  if (ioDirectoryOpen(state->disk_info, &iterator, folder_to_remove.inode) == EXIT_SUCCESS) {
+    while (ioDirectoryNext(state->disk_info, &iterator, &item) == EXIT_SUCCESS) {
+      if (strcmp(item.name, ".") != 0 && strcmp(item.name, "..") != 0) {
+        is_empty = 0;
+        break;
+      }
     }
-  }
 
-  read_index +=
-    ioDirectoryEntry(state->disk_info, &first_item, &first_item_inode, read_index, IOMODE_READ);
+    ioDirectoryClose(&iterator);
+  }
 
-  if (!isEndDirectory(&first_item)) {
+  if (!is_empty) {
     printf("rmdir: %s: Directory not empty\n", parameter);
-    return;
-  }
+  } else {
+    // Store the INode in memory before we start killing things:
+    ioINode(state->disk_info, &to_remove_inode, folder_to_remove.inode, IOMODE_READ);
 
-  // Store the INode in memory before we start killing things:
-  ioINode(state->disk_info, &to_remove_inode, folder_to_remove.inode, IOMODE_READ);
+    // Now we can dealloc the dir
+    deallocateDirectoryEntry(state->disk_info, parent_folder.inode, stub);
 
-  // Now we can dealloc the dir
-  deallocateDirectoryEntry(state->disk_info, parent_folder.inode, stub);
+    // And get rid of the INode! Its blocks are freed in the background.
+    orphanAdd(state->disk_info, folder_to_remove.inode);
+  }
 
-  // And get rid of the INode!
-  deallocateINode(state->disk_info, folder_to_remove.inode);
+  cacheUnlockINode(state->disk_info, folder_to_remove.inode);
+  cacheUnlockINode(state->disk_info, parent_folder.inode);
 }
 
 /**
@@ -144,13 +160,17 @@ void runCAT(State* state, char* parameter) {
   }
 
   INode inode;
+
+  // A writer of the file finishes before it is read
+  cacheLockINode(state->disk_info, found_file.inode);
   ioINode(state->disk_info, &inode, found_file.inode, IOMODE_READ);
 
   printFile(state->disk_info, &inode);
+  cacheUnlockINode(state->disk_info, found_file.inode);
 }
 
 /**
- * @brief Copys a file
+ * @brief Copys a file, the data is copied inside the kernel
  *
  * @param state
  * @param parameter
@@ -159,16 +179,24 @@ void runCP(State* state, char* parameter) {
   Directory parent_folder;
   Directory source_file;
   Directory dest_file;
+  Directory existing;
 
   char source[EXT2_NAME_LEN];
   char dest[EXT2_NAME_LEN];
 
   char* token = strtok(parameter, " ");
+
+  if (token == NULL) {
+    printf("cp: Must specify two paths\n");
+    return;
+  }
+
   strcpy(dest, token);
   token = strtok(NULL, " ");
 
   if (token == NULL) {
     printf("cp: Must specify two paths\n");
+    return;
   }
 
   strcpy(source, token);
@@ -185,54 +213,286 @@ void runCP(State* state, char* parameter) {
     return;
   }
 
+  // Check for room before anything is allocated, once a writer of the source is done with it
+  INode source_inode;
+  cacheLockINode(state->disk_info, source_file.inode);
+  ioINode(state->disk_info, &source_inode, source_file.inode, IOMODE_READ);
+  cacheUnlockINode(state->disk_info, source_file.inode);
+
+  int64_t needed_blocks =
+    (source_inode.i_size + state->disk_info->block_size - 1) / state->disk_info->block_size;
+  int64_t total_blocks = allocateBlocksNeeded(state->disk_info, needed_blocks);
+
+  // Preallocated blocks are handed over when nothing else is left
+  int64_t free_blocks = state->disk_info->free_blocks + state->disk_info->prealloc_cache->reserved;
+
+  if (free_blocks < total_blocks) {
+    printf("cp: Not enough free space (need %ld more blocks)\n", total_blocks - free_blocks);
+    return;
+  }
+
   // Dump the dir name to the disk
   strcpy(dest_file.name, dest);
   dest_file.name_len  = strlen(dest_file.name);
   dest_file.file_type = EXT2_FT_REG_FILE;
   dest_file.rec_len   = 8 + strlen(dest_file.name);
-  dest_file.inode     = allocateINode(state);
 
-  // Load the INodes we're about to copy
+  // Nobody else may add the name between the check and the new entry
+  cacheLockINode(state->disk_info, parent_folder.inode);
+
+  if (findEntry(state->disk_info, parent_folder.inode, dest_file.name, &existing) ==
+      EXIT_SUCCESS) {
+    printf("cp: cannot create file: '%s': File exists\n", dest);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
+    return;
+  }
+
+  dest_file.inode = allocateINode(state, parent_folder.inode, 0);
+
+  if (dest_file.inode == -1) {
+    printf("cp: cannot create file: '%s': No free INodes\n", dest);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
+    return;
+  }
+
+  // The copy is locked before its name shows up, readers wait until the data is in
+  cacheLockINode(state->disk_info, dest_file.inode);
+
   INode dest_inode;
-  INode source_inode;
   ioINode(state->disk_info, &dest_inode, dest_file.inode, IOMODE_READ);
+
+  allocateDirectoryEntry(state->disk_info, parent_folder.inode, &dest_file);
+  cacheUnlockINode(state->disk_info, parent_folder.inode);
+
+  // Lay out every block of the copy first, then let the kernel move the data across
+  allocateINodeBlocks(state->disk_info, &dest_inode, dest_file.inode, 0, needed_blocks);
+  dest_inode.i_size = source_inode.i_size;
+
+  // The source's blocks must not be freed underneath the copy
+  cacheLockINode(state->disk_info, source_file.inode);
   ioINode(state->disk_info, &source_inode, source_file.inode, IOMODE_READ);
 
-  if (state->disk_info->free_blocks < source_inode.i_blocks) {
-    printf("cp: Not enough free space (need %ld more blocks)\n",
-           source_inode.i_blocks - state->disk_info->free_blocks);
+  if (ioFileCopy(state->disk_info, &source_inode, &dest_inode, source_inode.i_size) ==
+      EXIT_FAILURE) {
+    printf("cp: %s: Unable to copy file\n", source);
+  }
+
+  cacheUnlockINode(state->disk_info, source_file.inode);
+
+  ioINode(state->disk_info, &dest_inode, dest_file.inode, IOMODE_WRITE);
+  cacheUnlockINode(state->disk_info, dest_file.inode);
+}
+
+/**
+ * @brief Removes a name from a directory. The INode goes on the orphan chain once its last
+ * name is gone, so its blocks are freed in the background.
+ *
+ * @param state
+ * @param parent_inode Directory holding the name
+ * @param name
+ * @return int32_t EXIT_FAILURE if the directory has no such name
+ */
+int32_t runRemoveEntry(State* state, int64_t parent_inode, char* name) {
+  Directory to_unlink;
+
+  // The directory is locked before the file, and both stay locked until the entry is gone
+  cacheLockINode(state->disk_info, parent_inode);
+
+  if (findEntry(state->disk_info, parent_inode, name, &to_unlink) == EXIT_FAILURE) {
+    cacheUnlockINode(state->disk_info, parent_inode);
+    return EXIT_FAILURE;
+  }
+
+  cacheLockINode(state->disk_info, to_unlink.inode);
+
+  INode source_inode;
+  ioINode(state->disk_info, &source_inode, to_unlink.inode, IOMODE_READ);
+
+  deallocateDirectoryEntry(state->disk_info, parent_inode, to_unlink.name);
+
+  // Files made here start out with no links counted, so the last entry may find 0 as well as 1
+  if (source_inode.i_links_count <= 1) {
+    orphanAdd(state->disk_info, to_unlink.inode);
+  } else {
+    source_inode.i_links_count--;
+    ioINode(state->disk_info, &source_inode, to_unlink.inode, IOMODE_WRITE);
+  }
+
+  cacheUnlockINode(state->disk_info, to_unlink.inode);
+  cacheUnlockINode(state->disk_info, parent_inode);
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Copies a file from the host into the image
+ *
+ * @param state
+ * @param parameter
+ */
+void runPUT(State* state, char* parameter) {
+  Directory   parent_folder;
+  Directory   new_file;
+  Directory   existing;
+  INode       new_inode;
+  struct stat host_stat;
+
+  char* host = strtok(parameter, " ");
+  char* path = strtok(NULL, " ");
+
+  if (host == NULL || path == NULL) {
+    printf("put: Must specify a host path and an image path\n");
     return;
   }
 
-  allocateDirectoryEntry(state->disk_info, parent_folder.inode, &dest_file);
-  // Allocate all of the blocks our dest INode will require:
-  allocateINodeBlocks(state->disk_info, &dest_inode, source_inode.i_blocks);
+  if (findPathParent(state, &parent_folder, path) == EXIT_FAILURE) {
+    printf("put: cannot create file: '%s': No such file or directory\n", path);
+    return;
+  }
 
-  // Lazily just load the entire file into ram:
-  int8_t* file_contents = (int8_t*)calloc(sizeof(int8_t), source_inode.i_size);
+  int32_t host_desc = open(host, O_RDONLY);
 
-  ioFile(state->disk_info, file_contents, &source_inode, source_inode.i_size, 0, IOMODE_READ);
-  ioFile(state->disk_info, file_contents, &dest_inode, source_inode.i_size, 0, IOMODE_WRITE);
+  if (host_desc < 0 || fstat(host_desc, &host_stat) != 0 || !S_ISREG(host_stat.st_mode)) {
+    printf("put: %s: Is not a readable regular file\n", host);
 
-  dest_inode.i_size = source_inode.i_size;
+    if (host_desc >= 0) {
+      close(host_desc);
+    }
 
-  ioINode(state->disk_info, &dest_inode, dest_file.inode, IOMODE_WRITE);
+    return;
+  }
+
+  // i_size holds 32 bits, and cp, get and cat don't read i_size_high
+  if (host_stat.st_size > UINT32_MAX) {
+    printf("put: %s: Files of 4 GiB or more are not supported\n", host);
+    close(host_desc);
+    return;
+  }
+
+  // Check for room before anything is allocated
+  int64_t needed_blocks =
+    (host_stat.st_size + state->disk_info->block_size - 1) / state->disk_info->block_size;
+  int64_t total_blocks = allocateBlocksNeeded(state->disk_info, needed_blocks);
+
+  // Preallocated blocks are handed over when nothing else is left
+  int64_t free_blocks = state->disk_info->free_blocks + state->disk_info->prealloc_cache->reserved;
+
+  if (free_blocks < total_blocks) {
+    printf("put: Not enough free space (need %ld more blocks)\n", total_blocks - free_blocks);
+    close(host_desc);
+    return;
+  }
+
+  getParameterStub(path, new_file.name);
+
+  new_file.name_len  = strlen(new_file.name);
+  new_file.file_type = EXT2_FT_REG_FILE;
+  new_file.rec_len   = 8 + strlen(new_file.name);
+
+  // Nobody else may add the name between the check and the new entry
+  cacheLockINode(state->disk_info, parent_folder.inode);
+
+  if (findEntry(state->disk_info, parent_folder.inode, new_file.name, &existing) ==
+      EXIT_SUCCESS) {
+    printf("put: cannot create file: '%s': File exists\n", path);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
+    close(host_desc);
+    return;
+  }
+
+  new_file.inode = allocateINode(state, parent_folder.inode, 0);
+
+  if (new_file.inode == -1) {
+    printf("put: cannot create file: '%s': No free INodes\n", path);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
+    close(host_desc);
+    return;
+  }
+
+  // The file is locked before its name shows up, readers wait until the data is in
+  cacheLockINode(state->disk_info, new_file.inode);
+
+  ioINode(state->disk_info, &new_inode, new_file.inode, IOMODE_READ);
+  allocateDirectoryEntry(state->disk_info, parent_folder.inode, &new_file);
+  cacheUnlockINode(state->disk_info, parent_folder.inode);
+
+  // Lay out every block first, then let the kernel move the data in
+  allocateINodeBlocks(state->disk_info, &new_inode, new_file.inode, 0, needed_blocks);
+  new_inode.i_size = host_stat.st_size;
+
+  int32_t status =
+    ioFileHost(state->disk_info, &new_inode, host_desc, host_stat.st_size, IOMODE_WRITE);
+
+  // The blocks are written down with the INode either way, so the orphan path can free them
+  ioINode(state->disk_info, &new_inode, new_file.inode, IOMODE_WRITE);
+  cacheUnlockINode(state->disk_info, new_file.inode);
+  close(host_desc);
+
+  if (status == EXIT_FAILURE) {
+    // A half written file doesn't stay behind under the name
+    printf("put: %s: Unable to copy file\n", host);
+    runRemoveEntry(state, parent_folder.inode, new_file.name);
+  }
 }
 
 /**
- * @brief Creates a file?
+ * @brief Copies a file out of the image to the host
  *
  * @param state
  * @param parameter
  */
-void runCREATE(State* state, char* parameter) {
-  Directory parent_folder;
+void runGET(State* state, char* parameter) {
+  Directory file;
+  INode     inode;
 
-  if (pathExists(state, parameter) == EXIT_SUCCESS) {
-    printf("create: cannot create file: '%s': File exists\n", parameter);
+  char* path = strtok(parameter, " ");
+  char* host = strtok(NULL, " ");
+
+  if (path == NULL || host == NULL) {
+    printf("get: Must specify an image path and a host path\n");
     return;
   }
 
+  if (findPath(state, &file, path) == EXIT_FAILURE) {
+    printf("get: %s: No such file or directory\n", path);
+    return;
+  }
+
+  if (file.file_type != EXT2_FT_REG_FILE) {
+    printf("get: %s: Is not a regular file\n", path);
+    return;
+  }
+
+  int32_t host_desc = open(host, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (host_desc < 0) {
+    printf("get: %s: %s\n", host, strerror(errno));
+    return;
+  }
+
+  // A writer of the file finishes before it is read
+  cacheLockINode(state->disk_info, file.inode);
+  ioINode(state->disk_info, &inode, file.inode, IOMODE_READ);
+
+  if (ioFileHost(state->disk_info, &inode, host_desc, inode.i_size, IOMODE_READ) ==
+      EXIT_FAILURE) {
+    printf("get: %s: Unable to copy file\n", path);
+  }
+
+  cacheUnlockINode(state->disk_info, file.inode);
+  close(host_desc);
+}
+
+/**
+ * @brief Creates a file?
+ *
+ * @param state
+ * @param parameter
+ */
+void runCREATE(State* state, char* parameter) {
+  Directory parent_folder;
+  Directory existing;
+
   if (findPathParent(state, &parent_folder, parameter) == EXIT_FAILURE) {
     printf("create: cannot create file: '%s': No such file or directory\n", parameter);
     return;
@@ -241,12 +501,24 @@ void runCREATE(State* state, char* parameter) {
   Directory new_file;
   getParameterStub(parameter, new_file.name);
 
+  // Nobody else may add the name between the check and the new entry
+  cacheLockINode(state->disk_info, parent_folder.inode);
+
+  if (findEntry(state->disk_info, parent_folder.inode, new_file.name, &existing) ==
+      EXIT_SUCCESS) {
+    printf("create: cannot create file: '%s': File exists\n", parameter);
+    cacheUnlockINode(state->disk_info, parent_folder.inode);
+    return;
+  }
+
   new_file.name_len  = strlen(new_file.name);
   new_file.file_type = EXT2_FT_REG_FILE;
   new_file.rec_len   = 8 + strlen(new_file.name);
-  new_file.inode     = allocateINode(state);
+  new_file.inode     = allocateINode(state, parent_folder.inode, 0);
 
   allocateDirectoryEntry(state->disk_info, parent_folder.inode, &new_file);
+
+  cacheUnlockINode(state->disk_info, parent_folder.inode);
 }
 
 /**
@@ -281,9 +553,11 @@ void runLINK(State* state, char* parameter) {
   findPathParent(state, &parent_folder, parameter);
 
   INode source_inode;
+  cacheLockINode(state->disk_info, source_file.inode);
   ioINode(state->disk_info, &source_inode, source_file.inode, IOMODE_READ);
   source_inode.i_links_count++;
   ioINode(state->disk_info, &source_inode, source_file.inode, IOMODE_WRITE);
+  cacheUnlockINode(state->disk_info, source_file.inode);
 
   strcpy(dest_file.name, dest);
   dest_file.name_len  = strlen(dest_file.name);
@@ -302,25 +576,18 @@ void runLINK(State* state, char* parameter) {
  */
 void runUNLINK(State* state, char* parameter) {
   Directory parent_folder;
-  Directory to_unlink;
+  char      stub[EXT2_NAME_LEN];
 
-  if (findPath(state, &to_unlink, parameter) == EXIT_FAILURE) {
+  if (findPathParent(state, &parent_folder, parameter) == EXIT_FAILURE) {
     printf("unlink: %s: No such file or directory\n", parameter);
     return;
   }
 
-  findPathParent(state, &parent_folder, parameter);
-
-  INode source_inode;
-  ioINode(state->disk_info, &source_inode, to_unlink.inode, IOMODE_READ);
-  source_inode.i_links_count--;
-  ioINode(state->disk_info, &source_inode, to_unlink.inode, IOMODE_WRITE);
+  getParameterStub(parameter, stub);
 
-  if (source_inode.i_links_count <= 0) {
-    deallocateINode(state->disk_info, to_unlink.inode);
+  if (runRemoveEntry(state, parent_folder.inode, stub) == EXIT_FAILURE) {
+    printf("unlink: %s: No such file or directory\n", parameter);
   }
-
-  deallocateDirectoryEntry(state->disk_info, parent_folder.inode, to_unlink.name);
 }
 
 /**
@@ -376,6 +643,10 @@ void runCD(State* state, char* parameter) {
 
   current_path->inode_number = found_file.inode;
 
+  // The working directory INode stays pinned in the INode cache
+  cachePinINode(state->disk_info, current_path->inode_number);
+  cacheUnpinINode(state->disk_info, state->path_cwd->inode_number);
+
   state->path_cwd = current_path;
 }
 
@@ -386,9 +657,6 @@ void runCD(State* state, char* parameter) {
  * @param parameter
  */
 void runBLOCKBITMAP(State* state, char* parameter) {
-  GroupDesc group_desc;
-  int8_t    buffer[state->disk_info->block_size];
-
   int64_t block_count = (int64_t)state->ext_info->super_block.s_blocks_count_hi << 32 |
                         state->ext_info->super_block.s_blocks_count;
 
@@ -399,8 +667,14 @@ void runBLOCKBITMAP(State* state, char* parameter) {
   }
 
   for (int32_t group = 0; group < state->disk_info->group_count; group++) {
-    ioGroupDescriptor(state->disk_info, &group_desc, group, IOMODE_READ);
-    ioBlock(state->disk_info, group_desc.bg_block_bitmap, (int8_t*)&buffer, IOMODE_READ);
+    cacheLockGroup(state->disk_info, group);
+
+    int8_t* buffer = cacheLoadBitmap(state->disk_info, group, BITMAP_BLOCK);
+
+    if (buffer == NULL) {
+      cacheUnlockGroup(state->disk_info, group);
+      break;
+    }
 
     for (int32_t pos = 0; pos < state->disk_info->blocks_per_group / 8; pos++) {
       int64_t real_block_pos = 8 * (pos + group * (state->disk_info->blocks_per_group / 8));
@@ -416,6 +690,8 @@ void runBLOCKBITMAP(State* state, char* parameter) {
       printBitmap(buffer[pos]);
       printf(" ");
     }
+
+    cacheUnlockGroup(state->disk_info, group);
   }
 
   printf("\n");
@@ -428,9 +704,6 @@ void runBLOCKBITMAP(State* state, char* parameter) {
  * @param parameter
  */
 void runINODEBITMAP(State* state, char* parameter) {
-  GroupDesc group_desc;
-  int8_t    buffer[state->disk_info->block_size];
-
   int64_t block_count = state->ext_info->super_block.s_inodes_count;
 
   printf("      ");
@@ -440,8 +713,14 @@ void runINODEBITMAP(State* state, char* parameter) {
   }
 
   for (int32_t group = 0; group < state->disk_info->group_count; group++) {
-    ioGroupDescriptor(state->disk_info, &group_desc, group, IOMODE_READ);
-    ioBlock(state->disk_info, group_desc.bg_inode_bitmap, (int8_t*)&buffer, IOMODE_READ);
+    cacheLockGroup(state->disk_info, group);
+
+    int8_t* buffer = cacheLoadBitmap(state->disk_info, group, BITMAP_INODE);
+
+    if (buffer == NULL) {
+      cacheUnlockGroup(state->disk_info, group);
+      break;
+    }
 
     for (int32_t pos = 0; pos < state->disk_info->inodes_per_group / 8; pos++) {
       int64_t real_block_pos = 8 * (pos + group * (state->disk_info->inodes_per_group / 8));
@@ -457,11 +736,182 @@ void runINODEBITMAP(State* state, char* parameter) {
       printBitmap(buffer[pos]);
       printf(" ");
     }
+
+    cacheUnlockGroup(state->disk_info, group);
   }
 
   printf("\n");
 }
 
+/**
+ * @brief Writes everything held in memory back to the disk
+ *
+ * @param state
+ * @param parameter
+ */
+void runSYNC(State* state, char* parameter) {
+  if (ioSync(state->disk_info) == EXIT_FAILURE) {
+    printf("sync: Unable to write back to the disk\n");
+  }
+}
+
+/**
+ * @brief Shows how far the background reclaim of removed files has got
+ *
+ * @param state
+ * @param parameter
+ */
+void runSTATUS(State* state, char* parameter) {
+  OrphanList* orphans = state->disk_info->orphans;
+
+  pthread_mutex_lock(&orphans->lock);
+
+  printf("%17s: %10li\n", "Orphans Pending", orphans->pending);
+  printf("%17s: %10li\n", "Reclaiming INode", orphans->current);
+  printf("%17s: %10li\n", "Blocks Left", orphans->current != 0 ? orphans->blocks_left : 0);
+  printf("%17s: %10li\n", "Reclaimed INodes", orphans->reclaimed_inodes);
+  printf("%17s: %10li\n", "Reclaimed Blocks", orphans->reclaimed_blocks);
+
+  pthread_mutex_unlock(&orphans->lock);
+}
+
+/**
+ * @brief Walks the directory tree under a path for du, find and tree
+ *
+ * @param state
+ * @param walker
+ * @param mode
+ * @param command Name the errors are printed under
+ * @param path Empty for the current directory
+ * @param pattern
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t runWalk(State* state, Walker* walker, WalkMode mode, char* command, char* path,
+                char* pattern) {
+  Directory found_file;
+
+  if (findPath(state, &found_file, path) == EXIT_FAILURE) {
+    printf("%s: %s: No such file or directory\n", command, path);
+    return EXIT_FAILURE;
+  }
+
+  if (found_file.file_type != EXT2_FT_DIR) {
+    printf("%s: %s: Not a directory\n", command, path);
+    return EXIT_FAILURE;
+  }
+
+  return walkTree(state->disk_info, walker, mode, path[0] != '\0' ? path : ".", found_file.inode,
+                  pattern);
+}
+
+/**
+ * @brief Runs DU, prints the KiB used under every directory
+ *
+ * @param state
+ * @param parameter
+ */
+void runDU(State* state, char* parameter) {
+  Walker      walker;
+  WalkRecord* records;
+  int64_t     count;
+  int64_t     directories;
+  int64_t     files;
+
+  if (runWalk(state, &walker, WALK_DU, "du", parameter, NULL) == EXIT_FAILURE) {
+    return;
+  }
+
+  walkMerge(&walker, &records, &count, &directories, &files);
+  walkSumDirectories(records, count);
+
+  for (int64_t pos = 0; pos < count; pos++) {
+    printf("%-10li %s\n", records[pos].blocks * state->disk_info->block_size / 1024,
+           records[pos].path);
+  }
+
+  walkFreeRecords(records, count);
+  walkRelease(&walker);
+}
+
+/**
+ * @brief Runs FIND, takes an optional path followed by -name and a pattern
+ *
+ * @param state
+ * @param parameter
+ */
+void runFIND(State* state, char* parameter) {
+  Walker      walker;
+  WalkRecord* records;
+  int64_t     count;
+  int64_t     directories;
+  int64_t     files;
+
+  char* path    = "";
+  char* pattern = NULL;
+  char* token   = strtok(parameter, " ");
+
+  if (token != NULL && strcmp(token, "-name") != 0) {
+    path  = token;
+    token = strtok(NULL, " ");
+  }
+
+  if (token != NULL) {
+    pattern = strtok(NULL, " ");
+
+    if (strcmp(token, "-name") != 0 || pattern == NULL) {
+      printf("find: Usage: find [path] [-name pattern]\n");
+      return;
+    }
+  }
+
+  if (runWalk(state, &walker, WALK_FIND, "find", path, pattern) == EXIT_FAILURE) {
+    return;
+  }
+
+  walkMerge(&walker, &records, &count, &directories, &files);
+
+  for (int64_t pos = 0; pos < count; pos++) {
+    printf("%s\n", records[pos].path);
+  }
+
+  walkFreeRecords(records, count);
+  walkRelease(&walker);
+}
+
+/**
+ * @brief Runs TREE, prints everything under a directory indented by depth
+ *
+ * @param state
+ * @param parameter
+ */
+void runTREE(State* state, char* parameter) {
+  Walker      walker;
+  WalkRecord* records;
+  int64_t     count;
+  int64_t     directories;
+  int64_t     files;
+
+  if (runWalk(state, &walker, WALK_TREE, "tree", parameter, NULL) == EXIT_FAILURE) {
+    return;
+  }
+
+  walkMerge(&walker, &records, &count, &directories, &files);
+
+  printf("%s\n", parameter[0] != '\0' ? parameter : ".");
+
+  for (int64_t pos = 0; pos < count; pos++) {
+    char* name = strrchr(records[pos].path, '/');
+
+    printf("%*s%s%s\n", records[pos].depth * 4, "", name + 1,
+           records[pos].file_type == EXT2_FT_DIR ? "/" : "");
+  }
+
+  printf("\n%li directories, %li files\n", directories, files);
+
+  walkFreeRecords(records, count);
+  walkRelease(&walker);
+}
+
 /**
  * @brief Views an indirect block
  *
@@ -544,7 +994,8 @@ void runCommand(State* state, Command command, char* parameter) {
   void (*commands[])(State * state, char* parameter) = {
     runLS,        runMKDIR,       runRMDIR,       runCREATE,   runLINK, runUNLINK,
     runMKFS,      runCAT,         runCP,          runMENU,     runCD,   runDISKINFO,
-    runINODEINFO, runBLOCKBITMAP, runINODEBITMAP, runRAWBLOCK, runPWD
+    runINODEINFO, runBLOCKBITMAP, runINODEBITMAP, runRAWBLOCK, runPWD,  runPUT,
+    runGET,       runSYNC,        runSTATUS,      runDU,       runFIND, runTREE
   };
   (*commands[command])(state, parameter);
 }
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include "types.h"
 #include "utility.h"
 #include "find.h"
+#include "orphan.h"
+#include "walk.h"
 
 /**
  * @brief Runs a command on the filesystem
@@ -1,5 +1,72 @@
 #include "find.h"
 
+/**
+ * @brief Reads the "." entry of a directory
+ *
+ * @param disk_info
+ * @param found_file
+ * @param inode_no Directory INode
+ * @return int32_t
+ */
+int32_t findSelf(DiskInfo* disk_info, Directory* found_file, int64_t inode_no) {
+  DirectoryIterator iterator;
+
+  if (ioDirectoryOpen(disk_info, &iterator, inode_no) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  int32_t status = ioDirectoryNext(disk_info, &iterator, found_file);
+  ioDirectoryClose(&iterator);
+
+  return status;
+}
+
+/**
+ * @brief Searches a directory for a name, through its index when it has one
+ *
+ * @param disk_info
+ * @param inode_no Directory INode
+ * @param name
+ * @param found_file
+ * @return int32_t EXIT_SUCCESS if the name was found
+ */
+int32_t findEntry(DiskInfo* disk_info, int64_t inode_no, char* name, Directory* found_file) {
+  DirectoryIterator iterator;
+  int32_t           status = EXIT_FAILURE;
+
+  // An entry being added may move others between blocks, so don't look halfway through
+  cacheLockINode(disk_info, inode_no);
+
+  if (ioDirectoryOpen(disk_info, &iterator, inode_no) == EXIT_FAILURE) {
+    cacheUnlockINode(disk_info, inode_no);
+    return EXIT_FAILURE;
+  }
+
+  switch (htreeLookup(disk_info, &iterator.inode, name, found_file)) {
+    case HTREE_FOUND: {
+      status = EXIT_SUCCESS;
+      break;
+    }
+    case HTREE_NOT_FOUND: {
+      break;
+    }
+    case HTREE_UNINDEXED: {
+      while (ioDirectoryNext(disk_info, &iterator, found_file) == EXIT_SUCCESS) {
+        if (strcmp(found_file->name, name) == 0) {
+          status = EXIT_SUCCESS;
+          break;
+        }
+      }
+      break;
+    }
+  }
+
+  ioDirectoryClose(&iterator);
+  cacheUnlockINode(disk_info, inode_no);
+
+  return status;
+}
+
 /**
  * @brief Searches the disk for a path from the current path
  * Writes the Directory of the item on EXIT_SUCCESS
@@ -12,23 +79,14 @@
 int32_t findPath(State* state, Directory* found_file, char* parameter) {
   // We want the current dir:
   if (strlen(parameter) <= 0) {
-    INode inode;
-
-    ioINode(state->disk_info, &inode, state->path_cwd->inode_number, IOMODE_READ);
-    ioDirectoryEntry(state->disk_info, found_file, &inode, 0, IOMODE_READ);
-
-    return EXIT_SUCCESS;
+    return findSelf(state->disk_info, found_file, state->path_cwd->inode_number);
   }
 
   // We want root so grab the dir of root:
   if (parameter[0] == '/' && strlen(parameter) == 1) {
     clearPath(state, state->path_cwd);
-    INode inode;
 
-    ioINode(state->disk_info, &inode, EXT2_ROOT_INO, IOMODE_READ);
-    ioDirectoryEntry(state->disk_info, found_file, &inode, 0, IOMODE_READ);
-
-    return EXIT_SUCCESS;
+    return findSelf(state->disk_info, found_file, EXT2_ROOT_INO);
   }
 
   // We're searching from root, so clear our CWD:
@@ -48,39 +106,52 @@ int32_t findPath(State* state, Directory* found_file, char* parameter) {
   int32_t parameter_offset = 0;
 
   // Prepare to read the disk
-  INode     current_inode;
   Directory current_directory;
-  int64_t   directory_offset = 0;
 
   // Get the first bit of the path
 
   do {
     parsePath(item_name, parameter, &parameter_offset, &is_more);
-    ioINode(state->disk_info, &current_inode, current_path.inode_number, IOMODE_READ);
-    directory_offset += ioDirectoryEntry(state->disk_info, &current_directory, &current_inode,
-                                         directory_offset, IOMODE_READ);
-
-    // Search until the end for a matching name
-    while (strcmp(current_directory.name, item_name) != 0 && !isEndDirectory(&current_directory)) {
-      if (directory_offset % 4 != 0) {
-        directory_offset += 4 - (directory_offset % 4);
-      }
 
-      directory_offset += ioDirectoryEntry(state->disk_info, &current_directory, &current_inode,
-                                           directory_offset, IOMODE_READ);
+    // Try the directory entry cache before scanning the directory
+    switch (cacheLookupDentry(state->disk_info, current_path.inode_number, item_name,
+                              &current_directory)) {
+      case DENTRY_FOUND: {
+        bzero(&current_path, sizeof(Path));
+        current_path.inode_number = current_directory.inode;
+        strcpy(current_path.name, current_directory.name);
+        continue;
+      }
+      case DENTRY_NOT_FOUND: {
+        return EXIT_FAILURE;
+      }
+      default: break;
     }
 
+    // Search the directory for a matching name. The result is cached before the directory is
+    // unlocked, so an entry added or removed meanwhile can't be overwritten by a stale one.
+    cacheLockINode(state->disk_info, current_path.inode_number);
+
+    int32_t status = findEntry(state->disk_info, current_path.inode_number, item_name,
+                               &current_directory);
+
     // If we couldn't find a match and we searched until the end
-    if (isEndDirectory(&current_directory)) {
+    if (status == EXIT_FAILURE) {
+      cacheStoreDentry(state->disk_info, current_path.inode_number, item_name, 0,
+                       EXT2_FT_UNKNOWN);
+      cacheUnlockINode(state->disk_info, current_path.inode_number);
       return EXIT_FAILURE;
     }
 
+    cacheStoreDentry(state->disk_info, current_path.inode_number, current_directory.name,
+                     current_directory.inode, current_directory.file_type);
+    cacheUnlockINode(state->disk_info, current_path.inode_number);
+
     // If we somehow got an item we wanna dig into, switch to its dir table and reset our
     // dir_offset:
     bzero(&current_path, sizeof(Path));
     current_path.inode_number = current_directory.inode;
     strncpy(current_path.name, current_directory.name, current_directory.name_len);
-    directory_offset = 0;
   } while (is_more);
 
   memcpy(found_file, &current_directory, sizeof(Directory));
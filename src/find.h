@@ -1,8 +1,30 @@
 #ifndef FIND_H
 #define FIND_H
 
+#include "htree.h"
 #include "io.h"
 
+/**
+ * @brief Reads the "." entry of a directory
+ *
+ * @param disk_info
+ * @param found_file
+ * @param inode_no
+ * @return int32_t
+ */
+int32_t findSelf(DiskInfo* disk_info, Directory* found_file, int64_t inode_no);
+
+/**
+ * @brief Searches a directory for a name
+ *
+ * @param disk_info
+ * @param inode_no
+ * @param name
+ * @param found_file
+ * @return int32_t
+ */
+int32_t findEntry(DiskInfo* disk_info, int64_t inode_no, char* name, Directory* found_file);
+
 /**
  * @brief Searches the filesystem for a path
  *
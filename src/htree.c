@@ -0,0 +1,871 @@
+#include "htree.h"
+
+/**
+ * @brief Offset of the index information in the first block of an indexed directory, right
+ * after the "." and ".." entries
+ */
+#define HTREE_ROOT_INFO_OFFSET 24
+
+/**
+ * @brief Offset of the entries in an index block below the root, right after the unused
+ * directory entry that hides them from a linear scan
+ */
+#define HTREE_NODE_ENTRIES_OFFSET 8
+
+/**
+ * @brief Half MD4 helpers
+ */
+#define HTREE_MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define HTREE_MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define HTREE_MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define HTREE_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = (a << (s)) | (a >> (32 - (s))))
+#define HTREE_K2 013240474631UL
+#define HTREE_K3 015666365641UL
+
+/**
+ * @brief Checks if a directory keeps a hashed index of its entries
+ *
+ * @param inode
+ * @return int8_t
+ */
+int8_t htreeIsIndexed(INode* inode) {
+  return (inode->i_flags & EXT2_INDEX_FL) != 0;
+}
+
+/**
+ * @brief Mixes 32 bytes of a name into the hash buffer
+ *
+ * @param buffer
+ * @param in
+ */
+void htreeHalfMD4(uint32_t buffer[4], uint32_t in[8]) {
+  uint32_t a = buffer[0], b = buffer[1], c = buffer[2], d = buffer[3];
+
+  HTREE_ROUND(HTREE_MD4_F, a, b, c, d, in[0], 3);
+  HTREE_ROUND(HTREE_MD4_F, d, a, b, c, in[1], 7);
+  HTREE_ROUND(HTREE_MD4_F, c, d, a, b, in[2], 11);
+  HTREE_ROUND(HTREE_MD4_F, b, c, d, a, in[3], 19);
+  HTREE_ROUND(HTREE_MD4_F, a, b, c, d, in[4], 3);
+  HTREE_ROUND(HTREE_MD4_F, d, a, b, c, in[5], 7);
+  HTREE_ROUND(HTREE_MD4_F, c, d, a, b, in[6], 11);
+  HTREE_ROUND(HTREE_MD4_F, b, c, d, a, in[7], 19);
+
+  HTREE_ROUND(HTREE_MD4_G, a, b, c, d, in[1] + HTREE_K2, 3);
+  HTREE_ROUND(HTREE_MD4_G, d, a, b, c, in[3] + HTREE_K2, 5);
+  HTREE_ROUND(HTREE_MD4_G, c, d, a, b, in[5] + HTREE_K2, 9);
+  HTREE_ROUND(HTREE_MD4_G, b, c, d, a, in[7] + HTREE_K2, 13);
+  HTREE_ROUND(HTREE_MD4_G, a, b, c, d, in[0] + HTREE_K2, 3);
+  HTREE_ROUND(HTREE_MD4_G, d, a, b, c, in[2] + HTREE_K2, 5);
+  HTREE_ROUND(HTREE_MD4_G, c, d, a, b, in[4] + HTREE_K2, 9);
+  HTREE_ROUND(HTREE_MD4_G, b, c, d, a, in[6] + HTREE_K2, 13);
+
+  HTREE_ROUND(HTREE_MD4_H, a, b, c, d, in[3] + HTREE_K3, 3);
+  HTREE_ROUND(HTREE_MD4_H, d, a, b, c, in[7] + HTREE_K3, 9);
+  HTREE_ROUND(HTREE_MD4_H, c, d, a, b, in[2] + HTREE_K3, 11);
+  HTREE_ROUND(HTREE_MD4_H, b, c, d, a, in[6] + HTREE_K3, 15);
+  HTREE_ROUND(HTREE_MD4_H, a, b, c, d, in[1] + HTREE_K3, 3);
+  HTREE_ROUND(HTREE_MD4_H, d, a, b, c, in[5] + HTREE_K3, 9);
+  HTREE_ROUND(HTREE_MD4_H, c, d, a, b, in[0] + HTREE_K3, 11);
+  HTREE_ROUND(HTREE_MD4_H, b, c, d, a, in[4] + HTREE_K3, 15);
+
+  buffer[0] += a;
+  buffer[1] += b;
+  buffer[2] += c;
+  buffer[3] += d;
+}
+
+/**
+ * @brief Mixes 16 bytes of a name into the hash buffer
+ *
+ * @param buffer
+ * @param in
+ */
+void htreeTEA(uint32_t buffer[4], uint32_t in[4]) {
+  uint32_t sum = 0;
+  uint32_t b0 = buffer[0], b1 = buffer[1];
+
+  for (int32_t round = 0; round < 16; round++) {
+    sum += 0x9E3779B9;
+    b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+    b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+  }
+
+  buffer[0] += b0;
+  buffer[1] += b1;
+}
+
+/**
+ * @brief The original ext2 directory hash
+ *
+ * @param name
+ * @param name_len
+ * @param is_unsigned
+ * @return uint32_t
+ */
+uint32_t htreeLegacy(char* name, int32_t name_len, int8_t is_unsigned) {
+  uint32_t hash  = 0;
+  uint32_t hash0 = 0x12A3FE2D;
+  uint32_t hash1 = 0x37ABE8F9;
+
+  for (int32_t pos = 0; pos < name_len; pos++) {
+    int32_t c = is_unsigned ? (int32_t)(uint8_t)name[pos] : (int32_t)(int8_t)name[pos];
+
+    hash = hash1 + (hash0 ^ (c * 7152373));
+
+    if (hash & 0x80000000) {
+      hash -= 0x7FFFFFFF;
+    }
+
+    hash1 = hash0;
+    hash0 = hash;
+  }
+
+  return hash0 << 1;
+}
+
+/**
+ * @brief Packs up to count words of a name for the hash, padding with the name length
+ *
+ * @param name
+ * @param name_len Bytes left in the name
+ * @param words
+ * @param count
+ * @param is_unsigned
+ */
+void htreeNameWords(char* name, int32_t name_len, uint32_t* words, int32_t count,
+                    int8_t is_unsigned) {
+  uint32_t pad   = (uint32_t)name_len | ((uint32_t)name_len << 8);
+  uint32_t value = 0;
+
+  pad |= pad << 16;
+  value = pad;
+
+  if (name_len > count * 4) {
+    name_len = count * 4;
+  }
+
+  for (int32_t pos = 0; pos < name_len; pos++) {
+    int32_t c = is_unsigned ? (int32_t)(uint8_t)name[pos] : (int32_t)(int8_t)name[pos];
+
+    value = c + (value << 8);
+
+    if (pos % 4 == 3) {
+      *words++ = value;
+      value    = pad;
+      count--;
+    }
+  }
+
+  if (--count >= 0) {
+    *words++ = value;
+  }
+
+  while (--count >= 0) {
+    *words++ = pad;
+  }
+}
+
+/**
+ * @brief Hashes a name the way directory indexes do. The low bit is left clear, the index
+ * uses it to mark hash collisions that continue into the next leaf.
+ *
+ * @param disk_info
+ * @param name
+ * @param name_len
+ * @param hash_version
+ * @return uint32_t
+ */
+uint32_t htreeHash(DiskInfo* disk_info, char* name, int32_t name_len, int32_t hash_version) {
+  uint32_t buffer[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
+  uint32_t in[8];
+  uint32_t hash        = 0;
+  int8_t   is_unsigned = hash_version >= EXT2_HASH_LEGACY_UNSIGNED;
+
+  // An all zero seed means the default one
+  if (disk_info->hash_seed[0] || disk_info->hash_seed[1] || disk_info->hash_seed[2] ||
+      disk_info->hash_seed[3]) {
+    memcpy(buffer, disk_info->hash_seed, sizeof(buffer));
+  }
+
+  switch (hash_version) {
+    case EXT2_HASH_LEGACY:
+    case EXT2_HASH_LEGACY_UNSIGNED: {
+      hash = htreeLegacy(name, name_len, is_unsigned);
+      break;
+    }
+    case EXT2_HASH_HALF_MD4:
+    case EXT2_HASH_HALF_MD4_UNSIGNED: {
+      for (int32_t pos = 0; pos < name_len; pos += 32) {
+        htreeNameWords(name + pos, name_len - pos, in, 8, is_unsigned);
+        htreeHalfMD4(buffer, in);
+      }
+
+      hash = buffer[1];
+      break;
+    }
+    case EXT2_HASH_TEA:
+    case EXT2_HASH_TEA_UNSIGNED: {
+      for (int32_t pos = 0; pos < name_len; pos += 16) {
+        htreeNameWords(name + pos, name_len - pos, in, 4, is_unsigned);
+        htreeTEA(buffer, in);
+      }
+
+      hash = buffer[0];
+      break;
+    }
+  }
+
+  return hash & ~1;
+}
+
+/**
+ * @brief Gets the count and limit held in front of the entries of an index block
+ *
+ * @param entries
+ * @return DXCountLimit*
+ */
+DXCountLimit* htreeCountLimit(DXEntry* entries) {
+  return (DXCountLimit*)entries;
+}
+
+/**
+ * @brief Frees the index blocks held by a path
+ *
+ * @param path
+ */
+void htreeRelease(HTreePath* path) {
+  for (int32_t depth = 0; depth < HTREE_MAX_DEPTH; depth++) {
+    free(path->frames[depth].block);
+    path->frames[depth].block = NULL;
+  }
+}
+
+/**
+ * @brief Reads an index block into a frame
+ *
+ * @param disk_info
+ * @param inode
+ * @param frame
+ * @param block_pos
+ * @param entries_offset
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t htreeLoadFrame(DiskInfo* disk_info, INode* inode, HTreeFrame* frame, int64_t block_pos,
+                       int32_t entries_offset) {
+  if (frame->block == NULL) {
+    frame->block = (int8_t*)malloc(disk_info->block_size);
+  }
+
+  if (block_pos >= inode->i_size / disk_info->block_size ||
+      ioDirectoryBlock(disk_info, inode, block_pos, frame->block, IOMODE_READ) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  frame->block_pos = block_pos;
+  frame->entries   = (DXEntry*)(frame->block + entries_offset);
+  frame->entry     = 0;
+
+  DXCountLimit* count_limit = htreeCountLimit(frame->entries);
+
+  if (count_limit->count == 0 || count_limit->count > count_limit->limit ||
+      entries_offset + count_limit->limit * sizeof(DXEntry) > disk_info->block_size) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Finds the last entry of an index block whose hash is at or below a hash. The first
+ * entry covers every hash below the second.
+ *
+ * @param frame
+ * @param hash
+ * @return int32_t
+ */
+int32_t htreeSearchFrame(HTreeFrame* frame, uint32_t hash) {
+  int32_t low  = 1;
+  int32_t high = htreeCountLimit(frame->entries)->count - 1;
+
+  while (low <= high) {
+    int32_t middle = low + (high - low) / 2;
+
+    if (frame->entries[middle].hash > hash) {
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+  }
+
+  return low - 1;
+}
+
+/**
+ * @brief Walks the index from its root to the leaf a name hashes into
+ *
+ * @param disk_info
+ * @param inode
+ * @param name
+ * @param path
+ * @return int32_t EXIT_FAILURE if the index is damaged
+ */
+int32_t htreeProbe(DiskInfo* disk_info, INode* inode, char* name, HTreePath* path) {
+  bzero(path, sizeof(HTreePath));
+
+  if (htreeLoadFrame(disk_info, inode, &path->frames[0], 0,
+                     HTREE_ROOT_INFO_OFFSET + sizeof(DXRootInfo)) == EXIT_FAILURE) {
+    printf("htree: htreeProbe(): error: Damaged directory index\n");
+    return EXIT_FAILURE;
+  }
+
+  DXRootInfo* info = (DXRootInfo*)(path->frames[0].block + HTREE_ROOT_INFO_OFFSET);
+
+  if (info->reserved_zero != 0 || info->info_length != sizeof(DXRootInfo) ||
+      info->indirect_levels >= HTREE_MAX_DEPTH || info->hash_version > EXT2_HASH_TEA) {
+    printf("htree: htreeProbe(): error: Unsupported directory index\n");
+    return EXIT_FAILURE;
+  }
+
+  path->hash_version = info->hash_version + disk_info->hash_unsigned;
+  path->hash         = htreeHash(disk_info, name, strlen(name), path->hash_version);
+
+  for (int32_t depth = 0; depth <= info->indirect_levels; depth++) {
+    HTreeFrame* frame = &path->frames[depth];
+
+    if (depth > 0 && htreeLoadFrame(disk_info, inode, frame,
+                                    path->frames[depth - 1].entries[path->frames[depth - 1].entry]
+                                      .block,
+                                    HTREE_NODE_ENTRIES_OFFSET) == EXIT_FAILURE) {
+      printf("htree: htreeProbe(): error: Damaged directory index\n");
+      return EXIT_FAILURE;
+    }
+
+    frame->entry = htreeSearchFrame(frame, path->hash);
+    path->depth  = depth + 1;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Gets the directory block of the leaf a path ends at
+ *
+ * @param path
+ * @return int64_t
+ */
+int64_t htreeLeaf(HTreePath* path) {
+  HTreeFrame* frame = &path->frames[path->depth - 1];
+  return frame->entries[frame->entry].block;
+}
+
+/**
+ * @brief Moves a path on to the next leaf if names with the same hash continue there
+ *
+ * @param disk_info
+ * @param inode
+ * @param path
+ * @return int8_t 1 if the path moved
+ */
+int8_t htreeNextLeaf(DiskInfo* disk_info, INode* inode, HTreePath* path) {
+  int32_t depth = path->depth - 1;
+
+  // Climb until an index block has an entry after the one that was followed
+  while (path->frames[depth].entry + 1 >= htreeCountLimit(path->frames[depth].entries)->count) {
+    if (depth == 0) {
+      return 0;
+    }
+
+    depth--;
+  }
+
+  HTreeFrame* frame = &path->frames[depth];
+  frame->entry++;
+
+  if ((frame->entries[frame->entry].hash & ~1) != path->hash) {
+    return 0;
+  }
+
+  // Come back down along the first entry of every index block
+  for (depth++; depth < path->depth; depth++) {
+    if (htreeLoadFrame(disk_info, inode, &path->frames[depth],
+                       path->frames[depth - 1].entries[path->frames[depth - 1].entry].block,
+                       HTREE_NODE_ENTRIES_OFFSET) == EXIT_FAILURE) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * @brief Searches a leaf block for a name
+ *
+ * @param disk_info
+ * @param block
+ * @param name
+ * @param offset Offset of the entry that was found
+ * @param previous_offset Offset of the entry before it, or -1
+ * @return int32_t EXIT_SUCCESS if the name was found
+ */
+int32_t htreeScanLeaf(DiskInfo* disk_info, int8_t* block, char* name, int64_t* offset,
+                      int64_t* previous_offset) {
+  int32_t name_len = strlen(name);
+
+  *previous_offset = -1;
+
+  for (*offset = 0; *offset < disk_info->block_size;) {
+    Directory* entry = (Directory*)(block + *offset);
+
+    if (entry->rec_len < 8 || *offset + entry->rec_len > disk_info->block_size) {
+      printf("htree: htreeScanLeaf(): error: Damaged directory block\n");
+      return EXIT_FAILURE;
+    }
+
+    if (entry->inode != 0 && entry->name_len == name_len &&
+        memcmp(entry->name, name, name_len) == 0) {
+      return EXIT_SUCCESS;
+    }
+
+    *previous_offset = *offset;
+    *offset += entry->rec_len;
+  }
+
+  return EXIT_FAILURE;
+}
+
+/**
+ * @brief Looks a name up through the index of a directory
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @param name
+ * @param found_file
+ * @return HTreeResult
+ */
+HTreeResult htreeLookup(DiskInfo* disk_info, INode* inode, char* name, Directory* found_file) {
+  HTreePath   path;
+  HTreeResult result = HTREE_NOT_FOUND;
+  int8_t      buffer[disk_info->block_size];
+  int64_t     offset          = 0;
+  int64_t     previous_offset = 0;
+
+  if (!htreeIsIndexed(inode)) {
+    return HTREE_UNINDEXED;
+  }
+
+  if (htreeProbe(disk_info, inode, name, &path) == EXIT_FAILURE) {
+    htreeRelease(&path);
+    return HTREE_UNINDEXED;
+  }
+
+  do {
+    if (ioDirectoryBlock(disk_info, inode, htreeLeaf(&path), buffer, IOMODE_READ) ==
+        EXIT_FAILURE) {
+      break;
+    }
+
+    if (htreeScanLeaf(disk_info, buffer, name, &offset, &previous_offset) == EXIT_SUCCESS) {
+      Directory* entry = (Directory*)(buffer + offset);
+
+      memcpy(found_file, entry, 8);
+      memcpy(found_file->name, entry->name, entry->name_len);
+      found_file->name[entry->name_len] = '\0';
+
+      result = HTREE_FOUND;
+      break;
+    }
+  } while (htreeNextLeaf(disk_info, inode, &path));
+
+  htreeRelease(&path);
+  return result;
+}
+
+/**
+ * @brief Removes an entry from an indexed directory. Its space is merged into the entry
+ * before it, or it is marked unused when it starts the leaf.
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @param name
+ * @return HTreeResult
+ */
+HTreeResult htreeRemove(DiskInfo* disk_info, INode* inode, char* name) {
+  HTreePath   path;
+  HTreeResult result = HTREE_NOT_FOUND;
+  int8_t      buffer[disk_info->block_size];
+  int64_t     offset          = 0;
+  int64_t     previous_offset = 0;
+
+  if (!htreeIsIndexed(inode)) {
+    return HTREE_UNINDEXED;
+  }
+
+  if (htreeProbe(disk_info, inode, name, &path) == EXIT_FAILURE) {
+    htreeRelease(&path);
+    return HTREE_UNINDEXED;
+  }
+
+  do {
+    int64_t leaf = htreeLeaf(&path);
+
+    if (ioDirectoryBlock(disk_info, inode, leaf, buffer, IOMODE_READ) == EXIT_FAILURE) {
+      break;
+    }
+
+    if (htreeScanLeaf(disk_info, buffer, name, &offset, &previous_offset) == EXIT_SUCCESS) {
+      Directory* entry = (Directory*)(buffer + offset);
+
+      if (previous_offset == -1) {
+        entry->inode = 0;
+      } else {
+        ((Directory*)(buffer + previous_offset))->rec_len += entry->rec_len;
+      }
+
+      ioDirectoryBlock(disk_info, inode, leaf, buffer, IOMODE_WRITE);
+
+      result = HTREE_FOUND;
+      break;
+    }
+  } while (htreeNextLeaf(disk_info, inode, &path));
+
+  htreeRelease(&path);
+  return result;
+}
+
+/**
+ * @brief Orders leaf entries by hash
+ *
+ * @param left
+ * @param right
+ * @return int
+ */
+int htreeCompareMapEntries(const void* left, const void* right) {
+  uint32_t left_hash  = ((HTreeMapEntry*)left)->hash;
+  uint32_t right_hash = ((HTreeMapEntry*)right)->hash;
+
+  return (left_hash > right_hash) - (left_hash < right_hash);
+}
+
+/**
+ * @brief Writes entries of a directory block tightly packed into another block. The last one
+ * takes the rest of the block.
+ *
+ * @param disk_info
+ * @param source
+ * @param map Entries of source to copy
+ * @param count
+ * @param destination
+ */
+void htreePack(DiskInfo* disk_info, int8_t* source, HTreeMapEntry* map, int32_t count,
+               int8_t* destination) {
+  Directory* entry  = NULL;
+  int64_t    offset = 0;
+
+  bzero(destination, disk_info->block_size);
+
+  for (int32_t pos = 0; pos < count; pos++) {
+    Directory* source_entry = (Directory*)(source + map[pos].offset);
+    int64_t    rec_len      = calculateDirectoryEntryLength(source_entry->name_len);
+
+    entry = (Directory*)(destination + offset);
+    memcpy(entry, source_entry, 8 + source_entry->name_len);
+    entry->rec_len = rec_len;
+    offset += rec_len;
+  }
+
+  if (entry == NULL) {
+    entry = (Directory*)destination;
+  }
+
+  entry->rec_len += disk_info->block_size - offset;
+}
+
+/**
+ * @brief Collects the used entries of a directory block
+ *
+ * @param disk_info
+ * @param block
+ * @param start Offset of the first entry to collect
+ * @param map of at least block_size / 12 entries
+ * @param hash_version -1 to skip hashing
+ * @return int32_t Number of entries
+ */
+int32_t htreeMapBlock(DiskInfo* disk_info, int8_t* block, int64_t start, HTreeMapEntry* map,
+                      int32_t hash_version) {
+  int32_t count = 0;
+
+  for (int64_t offset = start; offset < disk_info->block_size;) {
+    Directory* entry = (Directory*)(block + offset);
+
+    if (entry->rec_len < 8 || offset + entry->rec_len > disk_info->block_size) {
+      return -1;
+    }
+
+    if (entry->inode != 0) {
+      map[count].offset = offset;
+      map[count].size   = calculateDirectoryEntryLength(entry->name_len);
+      map[count].hash =
+        hash_version == -1 ? 0
+                           : htreeHash(disk_info, entry->name, entry->name_len, hash_version);
+      count++;
+    }
+
+    offset += entry->rec_len;
+  }
+
+  return count;
+}
+
+/**
+ * @brief Adds an entry to an index block after the entry that was followed
+ *
+ * @param frame
+ * @param hash
+ * @param block_pos
+ */
+void htreeInsertIndex(HTreeFrame* frame, uint32_t hash, int64_t block_pos) {
+  DXCountLimit* count_limit = htreeCountLimit(frame->entries);
+  int32_t       at          = frame->entry + 1;
+
+  memmove(&frame->entries[at + 1], &frame->entries[at],
+          (count_limit->count - at) * sizeof(DXEntry));
+
+  frame->entries[at].hash  = hash;
+  frame->entries[at].block = block_pos;
+  count_limit->count++;
+}
+
+/**
+ * @brief Makes sure the index block at the end of a path has room for one more entry, by
+ * adding a level below the root or by splitting the lower index block
+ *
+ * @param disk_info
+ * @param inode
+ * @param path
+ * @return int32_t EXIT_FAILURE if the index is full
+ */
+int32_t htreeGrowIndex(DiskInfo* disk_info, INode* inode, HTreePath* path) {
+  int64_t       node_limit  = (disk_info->block_size - HTREE_NODE_ENTRIES_OFFSET) / sizeof(DXEntry);
+  HTreeFrame*   frame       = &path->frames[path->depth - 1];
+  HTreeFrame*   root        = &path->frames[0];
+  DXCountLimit* count_limit = htreeCountLimit(frame->entries);
+
+  if (count_limit->count < count_limit->limit) {
+    return EXIT_SUCCESS;
+  }
+
+  // Every index block below the root starts with an unused entry covering the whole block
+  int8_t*   node       = (int8_t*)calloc(1, disk_info->block_size);
+  Directory node_entry = { 0, disk_info->block_size, 0, EXT2_FT_UNKNOWN };
+  memcpy(node, &node_entry, 8);
+
+  if (path->depth == 1) {
+    // The root is full, so its entries move down into a new index block
+    DXRootInfo* info     = (DXRootInfo*)(root->block + HTREE_ROOT_INFO_OFFSET);
+    int64_t     node_pos = allocateDirectoryBlock(disk_info, inode);
+    DXEntry*    entries  = (DXEntry*)(node + HTREE_NODE_ENTRIES_OFFSET);
+
+    memcpy(entries, root->entries, count_limit->count * sizeof(DXEntry));
+    htreeCountLimit(entries)->limit = node_limit;
+
+    count_limit->count      = 1;
+    root->entries[0].block  = node_pos;
+    info->indirect_levels   = 1;
+
+    path->frames[1].block     = node;
+    path->frames[1].block_pos = node_pos;
+    path->frames[1].entries   = entries;
+    path->frames[1].entry     = root->entry;
+    root->entry               = 0;
+    path->depth               = 2;
+
+    ioDirectoryBlock(disk_info, inode, root->block_pos, root->block, IOMODE_WRITE);
+    ioDirectoryBlock(disk_info, inode, node_pos, node, IOMODE_WRITE);
+    return EXIT_SUCCESS;
+  }
+
+  if (htreeCountLimit(root->entries)->count >= htreeCountLimit(root->entries)->limit) {
+    printf("htree: htreeGrowIndex(): error: Directory index is full\n");
+    free(node);
+    return EXIT_FAILURE;
+  }
+
+  // Split the lower index block, the upper half of its entries move to a new one
+  int64_t  node_pos = allocateDirectoryBlock(disk_info, inode);
+  DXEntry* entries  = (DXEntry*)(node + HTREE_NODE_ENTRIES_OFFSET);
+  int32_t  half     = count_limit->count / 2;
+  uint32_t hash     = frame->entries[half].hash;
+
+  memcpy(entries, &frame->entries[half], (count_limit->count - half) * sizeof(DXEntry));
+  htreeCountLimit(entries)->count = count_limit->count - half;
+  htreeCountLimit(entries)->limit = node_limit;
+  count_limit->count              = half;
+
+  htreeInsertIndex(root, hash, node_pos);
+
+  ioDirectoryBlock(disk_info, inode, root->block_pos, root->block, IOMODE_WRITE);
+  ioDirectoryBlock(disk_info, inode, frame->block_pos, frame->block, IOMODE_WRITE);
+  ioDirectoryBlock(disk_info, inode, node_pos, node, IOMODE_WRITE);
+
+  // Follow whichever half the path was in
+  if (frame->entry >= half) {
+    free(frame->block);
+
+    frame->block     = node;
+    frame->block_pos = node_pos;
+    frame->entries   = entries;
+    frame->entry -= half;
+    root->entry++;
+  } else {
+    free(node);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Adds an entry to an indexed directory, splitting its leaf when it is full
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @param directory
+ * @return int32_t EXIT_FAILURE if the index can't take the entry
+ */
+int32_t htreeInsert(DiskInfo* disk_info, INode* inode, Directory* directory) {
+  HTreePath path;
+  int8_t    buffer[disk_info->block_size];
+  int8_t    split[disk_info->block_size];
+  int8_t    old[disk_info->block_size];
+
+  if (htreeProbe(disk_info, inode, directory->name, &path) == EXIT_FAILURE) {
+    htreeRelease(&path);
+    return EXIT_FAILURE;
+  }
+
+  int64_t leaf = htreeLeaf(&path);
+
+  if (ioDirectoryBlock(disk_info, inode, leaf, buffer, IOMODE_READ) == EXIT_FAILURE) {
+    htreeRelease(&path);
+    return EXIT_FAILURE;
+  }
+
+  if (allocateDirectorySlot(disk_info, buffer, directory) == EXIT_SUCCESS) {
+    ioDirectoryBlock(disk_info, inode, leaf, buffer, IOMODE_WRITE);
+    htreeRelease(&path);
+    return EXIT_SUCCESS;
+  }
+
+  // The leaf is full: sort its entries by hash and move the upper half to a new leaf
+  HTreeMapEntry map[disk_info->block_size / 12];
+  int32_t       count = htreeMapBlock(disk_info, buffer, 0, map, path.hash_version);
+
+  if (count < 2 || htreeGrowIndex(disk_info, inode, &path) == EXIT_FAILURE) {
+    htreeRelease(&path);
+    return EXIT_FAILURE;
+  }
+
+  qsort(map, count, sizeof(HTreeMapEntry), htreeCompareMapEntries);
+
+  // Move entries from the top until the new leaf holds about half the bytes, names vary too much
+  // in length to split by count
+  int32_t half  = count;
+  int64_t moved = 0;
+
+  while (half > 1 && moved + map[half - 1].size / 2 <= disk_info->block_size / 2) {
+    moved += map[--half].size;
+  }
+
+  if (half == count) {
+    half--;
+  }
+
+  uint32_t split_hash = map[half].hash;
+
+  // Names sharing a hash with the lower half mark the new leaf as a continuation
+  if (split_hash == map[half - 1].hash) {
+    split_hash |= 1;
+  }
+
+  memcpy(old, buffer, disk_info->block_size);
+  htreePack(disk_info, old, map, half, buffer);
+  htreePack(disk_info, old, map + half, count - half, split);
+
+  // Long names can still leave no room in the half the new one belongs to
+  if (allocateDirectorySlot(disk_info, path.hash >= split_hash ? split : buffer, directory) ==
+      EXIT_FAILURE) {
+    htreeRelease(&path);
+    return EXIT_FAILURE;
+  }
+
+  int64_t split_pos = allocateDirectoryBlock(disk_info, inode);
+
+  htreeInsertIndex(&path.frames[path.depth - 1], split_hash, split_pos);
+
+  HTreeFrame* frame = &path.frames[path.depth - 1];
+  ioDirectoryBlock(disk_info, inode, frame->block_pos, frame->block, IOMODE_WRITE);
+  ioDirectoryBlock(disk_info, inode, leaf, buffer, IOMODE_WRITE);
+  ioDirectoryBlock(disk_info, inode, split_pos, split, IOMODE_WRITE);
+
+  htreeRelease(&path);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Gives a single block directory an index. Everything but "." and ".." moves to a new
+ * leaf, and the rest of the first block becomes the root of the index.
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @return int32_t EXIT_FAILURE if the directory can't be indexed
+ */
+int32_t htreeCreate(DiskInfo* disk_info, INode* inode) {
+  int8_t     root[disk_info->block_size];
+  int8_t     leaf[disk_info->block_size];
+  Directory* self   = (Directory*)root;
+  Directory* parent = (Directory*)(root + 12);
+
+  if (disk_info->hash_version > EXT2_HASH_TEA ||
+      ioDirectoryBlock(disk_info, inode, 0, root, IOMODE_READ) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  // The root of the index sits at a fixed spot after "." and ".."
+  if (self->rec_len != 12 || self->name_len != 1 || parent->name_len != 2 ||
+      parent->rec_len < 12 || 12 + parent->rec_len > disk_info->block_size ||
+      strncmp(parent->name, "..", 2) != 0) {
+    return EXIT_FAILURE;
+  }
+
+  HTreeMapEntry map[disk_info->block_size / 12];
+  int32_t count = htreeMapBlock(disk_info, root, 12 + parent->rec_len, map, -1);
+
+  if (count < 0) {
+    return EXIT_FAILURE;
+  }
+
+  int64_t leaf_pos = allocateDirectoryBlock(disk_info, inode);
+  htreePack(disk_info, root, map, count, leaf);
+
+  parent->rec_len = disk_info->block_size - 12;
+  bzero(root + HTREE_ROOT_INFO_OFFSET, disk_info->block_size - HTREE_ROOT_INFO_OFFSET);
+
+  DXRootInfo*   info        = (DXRootInfo*)(root + HTREE_ROOT_INFO_OFFSET);
+  DXEntry*      entries     = (DXEntry*)(root + HTREE_ROOT_INFO_OFFSET + sizeof(DXRootInfo));
+  DXCountLimit* count_limit = htreeCountLimit(entries);
+
+  info->hash_version    = disk_info->hash_version;
+  info->info_length     = sizeof(DXRootInfo);
+  info->indirect_levels = 0;
+
+  count_limit->limit = (disk_info->block_size - HTREE_ROOT_INFO_OFFSET - sizeof(DXRootInfo)) /
+                       sizeof(DXEntry);
+  count_limit->count = 1;
+  entries[0].block   = leaf_pos;
+
+  ioDirectoryBlock(disk_info, inode, leaf_pos, leaf, IOMODE_WRITE);
+  ioDirectoryBlock(disk_info, inode, 0, root, IOMODE_WRITE);
+
+  inode->i_flags |= EXT2_INDEX_FL;
+
+  return EXIT_SUCCESS;
+}
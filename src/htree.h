@@ -0,0 +1,73 @@
+#ifndef HTREE_H
+#define HTREE_H
+
+#include "alloc.h"
+#include "io.h"
+#include "types.h"
+#include "utility.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Checks if a directory keeps a hashed index of its entries
+ *
+ * @param inode
+ * @return int8_t
+ */
+int8_t htreeIsIndexed(INode* inode);
+
+/**
+ * @brief Hashes a name the way directory indexes do
+ *
+ * @param disk_info
+ * @param name
+ * @param name_len
+ * @param hash_version
+ * @return uint32_t
+ */
+uint32_t htreeHash(DiskInfo* disk_info, char* name, int32_t name_len, int32_t hash_version);
+
+/**
+ * @brief Looks a name up through the index of a directory
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @param name
+ * @param found_file
+ * @return HTreeResult
+ */
+HTreeResult htreeLookup(DiskInfo* disk_info, INode* inode, char* name, Directory* found_file);
+
+/**
+ * @brief Adds an entry to an indexed directory, splitting its leaf when it is full. The caller
+ * writes the INode back.
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @param directory
+ * @return int32_t EXIT_FAILURE if the index can't take the entry
+ */
+int32_t htreeInsert(DiskInfo* disk_info, INode* inode, Directory* directory);
+
+/**
+ * @brief Removes an entry from an indexed directory
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @param name
+ * @return HTreeResult
+ */
+HTreeResult htreeRemove(DiskInfo* disk_info, INode* inode, char* name);
+
+/**
+ * @brief Gives a single block directory an index. The caller writes the INode back.
+ *
+ * @param disk_info
+ * @param inode Directory INode
+ * @return int32_t EXIT_FAILURE if the directory can't be indexed
+ */
+int32_t htreeCreate(DiskInfo* disk_info, INode* inode);
+
+#endif
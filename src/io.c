@@ -1,5 +1,174 @@
+#define _GNU_SOURCE  // copy_file_range(), fallocate()
+
 #include "io.h"
 
+/**
+ * @brief Maps the disk image into memory
+ *
+ * @param disk_info
+ */
+void ioMapDisk(DiskInfo* disk_info) {
+  struct stat disk_stat;
+
+  if (fstat(disk_info->file_desc, &disk_stat) != 0) {
+    printf("io: ioMapDisk(): error: Unable to stat disk image\n");
+    exit(EXIT_FAILURE);
+  }
+
+  void* map = mmap(NULL, disk_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   disk_info->file_desc, 0);
+
+  if (map == MAP_FAILED) {
+    printf("io: ioMapDisk(): error: Unable to map %ld bytes of disk image\n", disk_stat.st_size);
+    exit(EXIT_FAILURE);
+  }
+
+  disk_info->backend    = DISK_BACKEND_MMAP;
+  disk_info->map        = (int8_t*)map;
+  disk_info->map_length = disk_stat.st_size;
+}
+
+/**
+ * @brief Gets a pointer into the mapped image
+ *
+ * @param disk_info
+ * @param block
+ * @return int8_t*
+ */
+int8_t* ioBlockPointer(DiskInfo* disk_info, int64_t block) {
+  if (disk_info->backend != DISK_BACKEND_MMAP) {
+    return NULL;
+  }
+
+  if (block < 0 || (block + 1) * disk_info->block_size > disk_info->map_length) {
+    printf("io: ioBlockPointer(): error: Block %5ld is past the end of the disk\n", block);
+    exit(EXIT_FAILURE);
+  }
+
+  return disk_info->map + block * disk_info->block_size;
+}
+
+/**
+ * @brief Hints the kernel about how a range of blocks will be accessed
+ *
+ * @param disk_info
+ * @param block
+ * @param count
+ * @param advice
+ */
+void ioAdvise(DiskInfo* disk_info, int64_t block, int64_t count, IOAdvice advice) {
+  if (disk_info->backend != DISK_BACKEND_MMAP || count <= 0) {
+    return;
+  }
+
+  // madvise() needs a page aligned start
+  int64_t page_size = sysconf(_SC_PAGESIZE);
+  int64_t start     = block * disk_info->block_size;
+  int64_t end       = start + count * disk_info->block_size;
+
+  start -= start % page_size;
+
+  if (end > disk_info->map_length) {
+    end = disk_info->map_length;
+  }
+
+  madvise(disk_info->map + start, end - start,
+          advice == IOADVICE_SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
+
+/**
+ * @brief Perform an IO operation on a list of buffers laid out back to back in a file.
+ * Short transfers are retried until everything has been moved.
+ *
+ * @param file_desc
+ * @param vectors Consumed as the transfer progresses
+ * @param count Number of vectors
+ * @param offset Offset in the file
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioDescriptorVector(int32_t file_desc, struct iovec* vectors, int32_t count, int64_t offset,
+                           IOMode mode) {
+  while (1) {
+    // Skip over everything that has already been transferred
+    while (count > 0 && vectors->iov_len == 0) {
+      vectors++;
+      count--;
+    }
+
+    if (count == 0) {
+      return EXIT_SUCCESS;
+    }
+
+    int32_t batch = count < IO_VECTOR_MAX ? count : IO_VECTOR_MAX;
+    ssize_t done  = mode == IOMODE_READ ? preadv(file_desc, vectors, batch, offset)
+                                        : pwritev(file_desc, vectors, batch, offset);
+
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (done < 0) {
+      printf("io: ioDescriptorVector(): error: IO at %5ld failed: %s\n", offset, strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+    if (done == 0) {
+      printf("io: ioDescriptorVector(): error: Unexpected end of file at %5ld\n", offset);
+      return EXIT_FAILURE;
+    }
+
+    offset += done;
+
+    for (int32_t pos = 0; pos < batch && done > 0; pos++) {
+      int64_t taken = (size_t)done < vectors[pos].iov_len ? done : (int64_t)vectors[pos].iov_len;
+
+      vectors[pos].iov_base = (int8_t*)vectors[pos].iov_base + taken;
+      vectors[pos].iov_len -= taken;
+      done -= taken;
+    }
+  }
+}
+
+/**
+ * @brief Perform an IO operation on a list of buffers laid out back to back on the disk.
+ * Short transfers are retried until everything has been moved.
+ *
+ * @param disk_info
+ * @param vectors Consumed as the transfer progresses
+ * @param count Number of vectors
+ * @param offset Offset on disk
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioBytesVector(DiskInfo* disk_info, struct iovec* vectors, int32_t count, int64_t offset,
+                      IOMode mode) {
+  if (mode != IOMODE_READ && mode != IOMODE_WRITE) {
+    printf("io: ioBytesVector(): error: Unsupported IOMode %5d\n", mode);
+    exit(EXIT_FAILURE);
+  }
+
+  if (disk_info->backend == DISK_BACKEND_MMAP) {
+    for (int32_t pos = 0; pos < count; offset += vectors[pos++].iov_len) {
+      if (offset < 0 || offset + (int64_t)vectors[pos].iov_len > disk_info->map_length) {
+        printf("io: ioBytesVector(): error: Access from %5ld to %5ld is past the end of the disk\n",
+               offset, offset + vectors[pos].iov_len);
+        return EXIT_FAILURE;
+      }
+
+      if (mode == IOMODE_READ) {
+        memcpy(vectors[pos].iov_base, disk_info->map + offset, vectors[pos].iov_len);
+      } else {
+        memcpy(disk_info->map + offset, vectors[pos].iov_base, vectors[pos].iov_len);
+      }
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  return ioDescriptorVector(disk_info->file_desc, vectors, count, offset, mode);
+}
+
 /**
  * @brief Perform an IO operation on some bytes
  *
@@ -8,30 +177,62 @@
  * @param length Length of buffer
  * @param offset Offset on disk
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioBytes(DiskInfo* disk_info, int8_t* buffer, int64_t length, int64_t offset, IOMode mode) {
-  lseek(disk_info->file_desc, offset, SEEK_SET);
+int32_t ioBytes(DiskInfo* disk_info, int8_t* buffer, int64_t length, int64_t offset, IOMode mode) {
+  // printf("io: ioBytes(): info: Seeking %5ld bytes from %5ld to %5ld for mode %5d\n", length,
+  //        offset, offset + length, mode);
 
-  switch (mode) {
-    case IOMODE_READ: {
-      // printf("io: ioBytes(): info: Reading %5ld bytes from %5ld to %5ld\n", length, offset,
-      //        offset + length);
+  struct iovec vector = { buffer, length };
 
-      read(disk_info->file_desc, buffer, length);
-      return;
-    }
-    case IOMODE_WRITE: {
-      // printf("io: ioBytes(): info: Writing %5ld bytes from %5ld to %5ld\n", length, offset,
-      //       offset + length);
+  return ioBytesVector(disk_info, &vector, 1, offset, mode);
+}
 
-      write(disk_info->file_desc, buffer, length);
-      return;
-    }
-    default: {
-      printf("io: ioBytes(): error: Unsupported IOMode %5d\n", mode);
-      exit(EXIT_FAILURE);
-    }
+/**
+ * @brief Zeroes a run of blocks on the disk. A hole is punched in the image file where the host
+ * filesystem allows it, otherwise zeros are written a chunk at a time. Cached copies of the
+ * blocks are dropped.
+ *
+ * @param disk_info
+ * @param block
+ * @param count
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioZeroBlocks(DiskInfo* disk_info, int64_t block, int64_t count) {
+  int64_t offset = block * disk_info->block_size;
+  int64_t length = count * disk_info->block_size;
+
+  cacheDropBlocks(disk_info, block, count);
+
+  // The mapping shares the file's pages, so a punched hole shows through it as well
+  if (fallocate(disk_info->file_desc, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                length) == 0) {
+    return EXIT_SUCCESS;
+  }
+
+  if (errno != EOPNOTSUPP && errno != ENOSYS) {
+    printf("io: ioZeroBlocks(): error: Unable to punch %5ld blocks at %5ld: %s\n", count, block,
+           strerror(errno));
+    return EXIT_FAILURE;
   }
+
+  int8_t* zeros  = (int8_t*)calloc(1, IO_CHUNK_SIZE);
+  int32_t status = EXIT_SUCCESS;
+
+  if (zeros == NULL) {
+    printf("io: ioZeroBlocks(): error: Unable to allocate a %d byte chunk\n", IO_CHUNK_SIZE);
+    return EXIT_FAILURE;
+  }
+
+  for (int64_t done = 0; done < length && status == EXIT_SUCCESS; done += IO_CHUNK_SIZE) {
+    int64_t chunk_length = length - done < IO_CHUNK_SIZE ? length - done : IO_CHUNK_SIZE;
+
+    status = ioBytes(disk_info, zeros, chunk_length, offset + done, IOMODE_WRITE);
+  }
+
+  free(zeros);
+
+  return status;
 }
 
 /**
@@ -41,9 +242,10 @@ void ioBytes(DiskInfo* disk_info, int8_t* buffer, int64_t length, int64_t offset
  * @param buffer
  * @param block
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, IOMode mode) {
-  ioBytes(disk_info, buffer, disk_info->block_size, block * disk_info->block_size, mode);
+int32_t ioBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, IOMode mode) {
+  return ioBlockPart(disk_info, buffer, block, disk_info->block_size, 0, mode);
 }
 
 /**
@@ -55,9 +257,10 @@ void ioBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, IOMode mode) {
  * @param bytes
  * @param offset
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioBlockPart(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t length, int64_t offset,
-                 IOMode mode) {
+int32_t ioBlockPart(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t length,
+                    int64_t offset, IOMode mode) {
   if (length + offset > disk_info->block_size) {
     printf(
       "io: ioBlockPart(): error: Attempted to seek past block boundaries on block %5ld from bytes "
@@ -70,74 +273,310 @@ void ioBlockPart(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t len
   // printf("io: ioBlockPart(): info: Seeking block %5ld from %5ld to %5ld for mode %5d\n", block,
   //        offset, offset + length, mode);
 
-  ioBytes(disk_info, buffer, length, block * disk_info->block_size + offset, mode);
+  // A decoded copy of an indirect block goes stale once the block is written
+  if (mode == IOMODE_WRITE) {
+    cacheInvalidateBlockMap(disk_info, block);
+  }
+
+  // The mapped image needs no cache, hand out the block directly
+  int8_t* mapped = ioBlockPointer(disk_info, block);
+
+  if (mapped != NULL) {
+    if (mode == IOMODE_READ) {
+      memcpy(buffer, mapped + offset, length);
+    } else {
+      memcpy(mapped + offset, buffer, length);
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  switch (mode) {
+    case IOMODE_READ: {
+      return cacheLoadBlock(disk_info, block, buffer, length, offset);
+    }
+    case IOMODE_WRITE: {
+      return cacheStoreBlock(disk_info, block, buffer, length, offset);
+    }
+    default: {
+      printf("io: ioBlockPart(): error: Unsupported IOMode %5d\n", mode);
+      exit(EXIT_FAILURE);
+    }
+  }
 }
 
 /**
- * @brief Do an IO operation on a group descriptor
+ * @brief Do an IO operation on the whole group descriptor table
+ *
+ * @param disk_info
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioGroupDescriptorTable(DiskInfo* disk_info, IOMode mode) {
+  int8_t* table        = (int8_t*)disk_info->group_descs;
+  int64_t table_length = disk_info->group_count * sizeof(GroupDesc);
+  int32_t status       = EXIT_SUCCESS;
+
+  // No descriptor may change while the table is copied out. Locking in group order keeps two
+  // writers from waiting on each other, and a change made meanwhile marks the table again.
+  if (mode == IOMODE_WRITE) {
+    for (int64_t group = 0; group < disk_info->group_count; group++) {
+      cacheLockGroup(disk_info, group);
+    }
+
+    disk_info->group_descs_dirty = 0;
+  }
+
+  // The table may span several blocks
+  for (int64_t table_pos = 0; table_pos < table_length && status == EXIT_SUCCESS;
+       table_pos += disk_info->block_size) {
+    int64_t length = table_length - table_pos;
+
+    if (length > disk_info->block_size) {
+      length = disk_info->block_size;
+    }
+
+    status = ioBlockPart(disk_info, table + table_pos,
+                         disk_info->group_desc_block + table_pos / disk_info->block_size, length,
+                         0, mode);
+  }
+
+  if (mode == IOMODE_WRITE) {
+    // Try again on the next flush
+    if (status == EXIT_FAILURE) {
+      disk_info->group_descs_dirty = 1;
+    }
+
+    for (int64_t group = disk_info->group_count - 1; group >= 0; group--) {
+      cacheUnlockGroup(disk_info, group);
+    }
+  }
+
+  return status;
+}
+
+/**
+ * @brief Do an IO operation on a group descriptor. Descriptors live in memory once mounted and
+ * are written back on flush. The group must be locked.
  *
  * @param disk_info
  * @param group
  * @param group_no
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioGroupDescriptor(DiskInfo* disk_info, GroupDesc* group, int64_t group_no, IOMode mode) {
+int32_t ioGroupDescriptor(DiskInfo* disk_info, GroupDesc* group, int64_t group_no, IOMode mode) {
   // printf("io: ioGroupDescriptor(): Seeking Group %4ld\n", group_no);
-  ioBlockPart(disk_info, (int8_t*)group, 2, sizeof(GroupDesc), group_no * sizeof(GroupDesc), mode);
+  if (group_no < 0 || group_no >= disk_info->group_count) {
+    printf("io: ioGroupDescriptor(): error: Group %4ld does not exist\n", group_no);
+    return EXIT_FAILURE;
+  }
+
+  switch (mode) {
+    case IOMODE_READ: {
+      memcpy(group, &disk_info->group_descs[group_no], sizeof(GroupDesc));
+      return EXIT_SUCCESS;
+    }
+    case IOMODE_WRITE: {
+      memcpy(&disk_info->group_descs[group_no], group, sizeof(GroupDesc));
+      disk_info->group_descs_dirty = 1;
+      return EXIT_SUCCESS;
+    }
+    default: {
+      printf("io: ioGroupDescriptor(): error: Unsupported IOMode %5d\n", mode);
+      exit(EXIT_FAILURE);
+    }
+  }
 }
 
 /**
- * @brief Do an IO operation on an INode
+ * @brief Do an IO operation on an INode's slot in its group's INode table
  *
  * @param disk_info
  * @param inode
  * @param inode_no
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioINode(DiskInfo* disk_info, INode* inode, int64_t inode_no, IOMode mode) {
-  int64_t group_no    = (inode_no - 1) / disk_info->inodes_per_group;
-  int32_t table_index = (inode_no - 1) % disk_info->inodes_per_group;
+int32_t ioINodeTable(DiskInfo* disk_info, INode* inode, int64_t inode_no, IOMode mode) {
+  int64_t group_no     = (inode_no - 1) / disk_info->inodes_per_group;
+  int32_t table_index  = (inode_no - 1) % disk_info->inodes_per_group;
+  int64_t table_offset = (int64_t)table_index * disk_info->inode_size;
 
-  // printf("io: ioINode(): Seeking INode %4ld\n", inode_no);
+  // printf("io: ioINodeTable(): Seeking INode %4ld\n", inode_no);
 
-  GroupDesc group_desc;
+  if (group_no < 0 || group_no >= disk_info->group_count) {
+    printf("io: ioINodeTable(): error: Group %4ld does not exist\n", group_no);
+    return EXIT_FAILURE;
+  }
 
-  ioGroupDescriptor(disk_info, &group_desc, group_no, IOMODE_READ);
+  // The table never moves, so it is found without locking the group
+  int64_t table_block = disk_info->group_descs[group_no].bg_inode_table;
 
-  ioBytes(disk_info, (int8_t*)inode, sizeof(INode),
-          group_desc.bg_inode_table * disk_info->block_size + (table_index * sizeof(INode)), mode);
+  // Only the classic 128 byte INode is used, anything past it in larger INodes is left alone
+  return ioBlockPart(disk_info, (int8_t*)inode, table_block + table_offset / disk_info->block_size,
+                     sizeof(INode), table_offset % disk_info->block_size, mode);
+}
+
+/**
+ * @brief Do an IO operation on an INode through the INode cache
+ *
+ * @param disk_info
+ * @param inode
+ * @param inode_no
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioINode(DiskInfo* disk_info, INode* inode, int64_t inode_no, IOMode mode) {
+  if (inode_no < 1 || inode_no > disk_info->inode_count) {
+    printf("io: ioINode(): error: INode %4ld does not exist\n", inode_no);
+    return EXIT_FAILURE;
+  }
+
+  switch (mode) {
+    case IOMODE_READ: {
+      return cacheLoadINode(disk_info, inode, inode_no);
+    }
+    case IOMODE_WRITE: {
+      return cacheStoreINode(disk_info, inode, inode_no);
+    }
+    default: {
+      printf("io: ioINode(): error: Unsupported IOMode %5d\n", mode);
+      exit(EXIT_FAILURE);
+    }
+  }
 
   // if read   inode->i_blocks = inode->i_blocks / (2 << disk_info->s_log_block_size);
 }
 
 /**
- * @brief Does an IO operation on a Directory Entry
+ * @brief Does an IO operation on a whole block of a directory
  *
  * @param disk_info
- * @param directory
- * @param inode
- * @param offset
+ * @param inode Directory INode
+ * @param block_pos Block within the directory
+ * @param buffer of block_size bytes
  * @param mode
- * @return int64_t
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-int64_t ioDirectoryEntry(DiskInfo* disk_info, Directory* directory, INode* inode, int64_t offset,
+int32_t ioDirectoryBlock(DiskInfo* disk_info, INode* inode, int64_t block_pos, int8_t* buffer,
                          IOMode mode) {
-  // printf("io: ioDirectoryEntry(): Seeking Dir Entry at offset %4ld\n", offset);
+  IndirectRange range    = calculateIndirectRange(disk_info);
+  int32_t       block_no = 0;
 
-  // Do the first part of the struct
-  ioFile(disk_info, (int8_t*)directory, inode, 8, offset, mode);
+  ioFileBlockHelper(disk_info, &block_no, inode, &range, block_pos);
 
-  // If we're doing a read, zero out the data we're about to write into
-  if (mode == IOMODE_READ) {
-    bzero(directory->name, sizeof(directory->name));
+  if (block_no == 0) {
+    printf("io: ioDirectoryBlock(): error: Directory block %5ld is not allocated\n", block_pos);
+    return EXIT_FAILURE;
+  }
+
+  return ioBlock(disk_info, block_no, buffer, mode);
+}
+
+/**
+ * @brief Starts walking a directory
+ *
+ * @param disk_info
+ * @param iterator
+ * @param inode_no Directory INode
+ * @return int32_t EXIT_FAILURE if the INode can't be read or isn't a directory
+ */
+int32_t ioDirectoryOpen(DiskInfo* disk_info, DirectoryIterator* iterator, int64_t inode_no) {
+  bzero(iterator, sizeof(DirectoryIterator));
+
+  if (ioINode(disk_info, &iterator->inode, inode_no, IOMODE_READ) == EXIT_FAILURE ||
+      (iterator->inode.i_mode & EXT2_S_IFMT) != EXT2_S_IFDIR) {
+    return EXIT_FAILURE;
+  }
+
+  iterator->block           = (int8_t*)malloc(disk_info->block_size);
+  iterator->block_count     = iterator->inode.i_size / disk_info->block_size;
+  iterator->block_pos       = -1;
+  iterator->offset          = disk_info->block_size;
+  iterator->entry_offset    = -1;
+  iterator->previous_offset = -1;
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Reads the next used entry of a directory. Entries are linked by rec_len and never
+ * cross a block boundary.
+ *
+ * @param disk_info
+ * @param iterator
+ * @param directory Entry that was read, with a terminated name
+ * @return int32_t EXIT_FAILURE at the end of the directory or on a damaged entry
+ */
+int32_t ioDirectoryNext(DiskInfo* disk_info, DirectoryIterator* iterator, Directory* directory) {
+  while (1) {
+    if (iterator->offset >= disk_info->block_size) {
+      if (iterator->block_pos + 1 >= iterator->block_count) {
+        return EXIT_FAILURE;
+      }
+
+      iterator->block_pos++;
+      iterator->offset       = 0;
+      iterator->entry_offset = -1;
+
+      if (ioDirectoryBlock(disk_info, &iterator->inode, iterator->block_pos, iterator->block,
+                           IOMODE_READ) == EXIT_FAILURE) {
+        return EXIT_FAILURE;
+      }
+    }
+
+    Directory* entry = (Directory*)(iterator->block + iterator->offset);
+
+    if (entry->rec_len < 8 || entry->rec_len % 4 != 0 ||
+        iterator->offset + entry->rec_len > disk_info->block_size ||
+        entry->name_len + 8 > entry->rec_len) {
+      printf("io: ioDirectoryNext(): error: Damaged entry in directory block %5ld at %5ld\n",
+             iterator->block_pos, iterator->offset);
+      return EXIT_FAILURE;
+    }
+
+    iterator->previous_offset = iterator->entry_offset;
+    iterator->entry_offset    = iterator->offset;
+    iterator->offset += entry->rec_len;
+
+    // Unused entries only hold space
+    if (entry->inode == 0) {
+      continue;
+    }
+
+    memcpy(directory, entry, 8);
+    memcpy(directory->name, entry->name, entry->name_len);
+    directory->name[entry->name_len] = '\0';
+
+    return EXIT_SUCCESS;
   }
+}
 
-  // Do the name
-  ioFile(disk_info, (int8_t*)directory->name, inode, directory->name_len, offset + 8, mode);
+/**
+ * @brief Stops walking a directory
+ *
+ * @param iterator
+ */
+void ioDirectoryClose(DirectoryIterator* iterator) {
+  free(iterator->block);
+  iterator->block = NULL;
+}
 
-  directory->rec_len = strlen(directory->name) + 8;
+/**
+ * @brief Reads one block number out of an indirect block
+ *
+ * @param disk_info
+ * @param block Indirect block, 0 if it isn't allocated
+ * @param index
+ * @return int32_t 0 if there is no such block
+ */
+int32_t ioIndirectBlock(DiskInfo* disk_info, int64_t block, int32_t index) {
+  if (block == 0) {
+    return 0;
+  }
 
-  return directory->rec_len;
+  return cacheLoadBlockMap(disk_info, block, index);
 }
 
 /**
@@ -147,8 +586,8 @@ int64_t ioDirectoryEntry(DiskInfo* disk_info, Directory* directory, INode* inode
  * We continuous adjust block_no to point to the next block we need to seek
  * from. For example, to read a double indirect block block_no is set to the double indirect
  * block. We read the correct index, and block_no now points to a single indirect block. We read
- * the index again, and now block_no points to the correct data. If I have more time, I will
- * cache the blocks.
+ * the index again, and now block_no points to the correct data. Indirect blocks are read through
+ * the block map cache, so walking a file only decodes each one once.
  *
  * @param disk_info
  * @param block_no
@@ -163,39 +602,33 @@ void ioFileBlockHelper(DiskInfo* disk_info, int32_t* block_no, INode* inode, Ind
     int32_t block_index =
       (block_pos - range->triple_start) / (range->indirects_per_block) %
       (range->indirects_per_block * range->indirects_per_block * range->indirects_per_block);
-    int32_t block_offset = sizeof(int32_t) * block_index;
 
-    ioBlockPart(disk_info, (int8_t*)block_no, inode->i_block[EXT2_INDIRECT_TRIPLE], sizeof(int32_t),
-                block_offset, IOMODE_READ);
+    *block_no = ioIndirectBlock(disk_info, inode->i_block[EXT2_INDIRECT_TRIPLE], block_index);
   }
 
   // Double Indirect reader:
   if (block_pos >= range->double_start) {
     int32_t block_index = (block_pos - range->double_start) / (range->indirects_per_block) %
                           (range->indirects_per_block * range->indirects_per_block);
-    int32_t block_offset = sizeof(int32_t) * block_index;
 
     // If triple indirect was NOT called, then work off of double indirect table
     if (!(block_pos >= range->triple_start)) {
       *block_no = inode->i_block[EXT2_INDIRECT_DOUBLE];
     }
 
-    ioBlockPart(disk_info, (int8_t*)block_no, *block_no, sizeof(int32_t), block_offset,
-                IOMODE_READ);
+    *block_no = ioIndirectBlock(disk_info, *block_no, block_index);
   }
 
   // Single Indirect reader:
   if (block_pos >= range->single_start) {
-    int32_t block_index  = (block_pos - range->single_start) % range->indirects_per_block;
-    int32_t block_offset = sizeof(int32_t) * block_index;
+    int32_t block_index = (block_pos - range->single_start) % range->indirects_per_block;
 
     // If double indirect was NOT called, then work off of single indirect table
     if (!(block_pos >= range->double_start)) {
       *block_no = inode->i_block[EXT2_INDIRECT_SINGLE];
     }
 
-    ioBlockPart(disk_info, (int8_t*)block_no, *block_no, sizeof(int32_t), block_offset,
-                IOMODE_READ);
+    *block_no = ioIndirectBlock(disk_info, *block_no, block_index);
   }
 
   // Direct Block reader:
@@ -204,8 +637,62 @@ void ioFileBlockHelper(DiskInfo* disk_info, int32_t* block_no, INode* inode, Ind
   }
 }
 
+/**
+ * @brief Marks each physically contiguous run of a file's blocks as about to be read in order
+ *
+ * @param disk_info
+ * @param inode
+ * @param range
+ * @param first_block
+ * @param block_count
+ */
+void ioAdviseFile(DiskInfo* disk_info, INode* inode, IndirectRange* range, int64_t first_block,
+                  int64_t block_count) {
+  int64_t run_start  = 0;
+  int64_t run_length = 0;
+
+  if (disk_info->backend != DISK_BACKEND_MMAP) {
+    return;
+  }
+
+  for (int64_t block_pos = first_block;
+       block_pos < first_block + block_count && block_pos < inode->i_blocks; block_pos++) {
+    int32_t block_no = 0;
+    ioFileBlockHelper(disk_info, &block_no, inode, range, block_pos);
+
+    if (run_length > 0 && block_no == run_start + run_length) {
+      run_length++;
+      continue;
+    }
+
+    ioAdvise(disk_info, run_start, run_length, IOADVICE_SEQUENTIAL);
+    run_start  = block_no;
+    run_length = 1;
+  }
+
+  ioAdvise(disk_info, run_start, run_length, IOADVICE_SEQUENTIAL);
+}
+
+/**
+ * @brief Does an IO operation on a run of physically consecutive whole blocks with a single
+ * transfer, keeping the block cache coherent with it
+ *
+ * @param disk_info
+ * @param buffer
+ * @param block First block of the run
+ * @param count
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioBlockRun(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t count,
+                   IOMode mode) {
+  return cacheBlockRun(disk_info, buffer, block, count, mode);
+}
+
 /**
  * @brief Do an IO operation on a file (the data an INode points to...)
+ * Whole blocks that are physically consecutive on the disk are moved with one transfer, only
+ * a partial first or last block goes through the block cache.
  *
  * @param disk_info
  * @param buffer Buffer to store data
@@ -213,53 +700,46 @@ void ioFileBlockHelper(DiskInfo* disk_info, int32_t* block_no, INode* inode, Ind
  * @param length
  * @param offset
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioFile(DiskInfo* disk_info, int8_t* buffer, INode* inode, int64_t length, int64_t offset,
-            IOMode mode) {
-  int32_t blocks_to_io  = length / disk_info->block_size + (length % disk_info->block_size != 0);
-  int32_t offset_blocks = offset / disk_info->block_size;
+int32_t ioFile(DiskInfo* disk_info, int8_t* buffer, INode* inode, int64_t length, int64_t offset,
+               IOMode mode) {
+  int64_t first_block = offset / disk_info->block_size;
+  int64_t last_block  = (offset + length - 1) / disk_info->block_size;
 
-  if (mode == IOMODE_READ) {
-    bzero(buffer, length);
+  if (length <= 0) {
+    return EXIT_SUCCESS;
   }
 
-  // printf("io: ioFile(): info: Seeking from %5ld to %5ld for mode %5d\n", offset, offset + length,
-  //       mode);
-
-  if (blocks_to_io > inode->i_blocks) {
-    printf("io: ioFile(): error: Requested to seek %5d blocks when there are only %5d blocks\n",
-           blocks_to_io, inode->i_blocks);
-
-    exit(EXIT_FAILURE);
+  if (mode == IOMODE_READ) {
+    bzero(buffer, length);
   }
 
-  if (blocks_to_io + offset_blocks > inode->i_blocks) {
+  if (last_block >= inode->i_blocks) {
     printf(
-      "io: ioFile(): warn: Requested to seek blocks %5d to %5d when there are only %5d blocks\n",
-      offset_blocks, blocks_to_io + offset_blocks, inode->i_blocks);
+      "io: ioFile(): warn: Requested to seek blocks %5ld to %5ld when there are only %5d blocks\n",
+      first_block, last_block + 1, inode->i_blocks);
 
-    exit(EXIT_FAILURE);
+    return EXIT_FAILURE;
   }
 
   IndirectRange range      = calculateIndirectRange(disk_info);
   int64_t       buffer_pos = 0;
 
-  for (int64_t block_pos = offset_blocks;
-       block_pos < blocks_to_io + offset_blocks && block_pos < inode->i_blocks; block_pos++) {
-    int32_t io_length = disk_info->block_size;  // Bytes to seek from this block
-    int32_t io_offset = 0;                      // Offset in bytes to seek from this block
-    int32_t block_no  = 0;                      // Block to read
+  if (last_block >= range.triple_end) {
+    printf("io: ioFile(): error: Requested block beyond max supported range of EXT2\n");
+    return EXIT_FAILURE;
+  }
 
-    // If we are the first read, adjust for our offset:
-    if (block_pos == offset_blocks) {
-      io_length -= offset;
-      io_offset += offset;
-    }
+  if (mode == IOMODE_READ && last_block > first_block) {
+    ioAdviseFile(disk_info, inode, &range, first_block, last_block - first_block + 1);
+  }
 
-    // If we are the last read, adjust for our offset:
-    if (block_pos == blocks_to_io + offset_blocks) {
-      io_length -= offset;
-    }
+  for (int64_t block_pos = first_block; block_pos <= last_block;) {
+    int64_t io_offset = block_pos == first_block ? offset % disk_info->block_size : 0;
+    int64_t io_length = disk_info->block_size - io_offset;  // Bytes to seek from this block
+    int64_t run       = 1;                                  // Blocks moved in one go
+    int32_t block_no  = 0;                                  // Block to read
 
     // And make sure we don't write past buffer:
     if (buffer_pos + io_length > length) {
@@ -270,15 +750,463 @@ void ioFile(DiskInfo* disk_info, int8_t* buffer, INode* inode, int64_t length, i
     ioFileBlockHelper(disk_info, &block_no, inode, &range, block_pos);
 
     if (block_no == 0) {
-      printf("io: ioFile(): error: Requested block 0\n");
+      // Holes read back as zeros
+      if (mode == IOMODE_WRITE) {
+        printf("io: ioFile(): error: Requested block 0\n");
+        return EXIT_FAILURE;
+      }
+    } else if (io_length < disk_info->block_size) {
+      if (ioBlockPart(disk_info, buffer + buffer_pos, block_no, io_length, io_offset, mode) ==
+          EXIT_FAILURE) {
+        return EXIT_FAILURE;
+      }
+    } else {
+      // Grow the run while the next whole block sits right after it on the disk
+      while (block_pos + run <= last_block &&
+             buffer_pos + (run + 1) * disk_info->block_size <= length) {
+        int32_t next_no = 0;
+        ioFileBlockHelper(disk_info, &next_no, inode, &range, block_pos + run);
+
+        if (next_no != block_no + run) {
+          break;
+        }
+
+        run++;
+      }
+
+      if (ioBlockRun(disk_info, buffer + buffer_pos, block_no, run, mode) == EXIT_FAILURE) {
+        return EXIT_FAILURE;
+      }
+
+      io_length = run * disk_info->block_size;
     }
 
-    ioBlockPart(disk_info, buffer + buffer_pos, block_no, io_length, io_offset, mode);
     buffer_pos += io_length;
+    block_pos += run;
+  }
 
-    if (block_pos > range.triple_end) {
-      printf("io: ioFile(): error: Requested block beyond max supported range of EXT2\n");
-      exit(EXIT_FAILURE);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Reads a file in order, handing each chunk to a handler as soon as it is read. Memory
+ * use stays at one chunk no matter how big the file is.
+ *
+ * @param disk_info
+ * @param inode File to read
+ * @param handler
+ * @param context Passed through to the handler
+ * @return int32_t EXIT_FAILURE on an IO error or when the handler stops early
+ */
+int32_t ioFileChunks(DiskInfo* disk_info, INode* inode, FileChunkHandler handler,
+                     void* context) {
+  int8_t* chunk  = (int8_t*)malloc(IO_CHUNK_SIZE);
+  int32_t status = EXIT_SUCCESS;
+
+  if (chunk == NULL) {
+    printf("io: ioFileChunks(): error: Unable to allocate a %d byte chunk\n", IO_CHUNK_SIZE);
+    return EXIT_FAILURE;
+  }
+
+  for (int64_t offset = 0; offset < inode->i_size && status == EXIT_SUCCESS;
+       offset += IO_CHUNK_SIZE) {
+    int64_t length = inode->i_size - offset;
+
+    if (length > IO_CHUNK_SIZE) {
+      length = IO_CHUNK_SIZE;
+    }
+
+    status = ioFile(disk_info, chunk, inode, length, offset, IOMODE_READ);
+
+    if (status == EXIT_SUCCESS) {
+      status = handler(chunk, length, context);
     }
   }
-}
\ No newline at end of file
+
+  free(chunk);
+
+  return status;
+}
+
+/**
+ * @brief Copies bytes between two files through a bounce buffer, for when the kernel can't copy
+ * them for us
+ *
+ * @param source_desc
+ * @param source_offset
+ * @param dest_desc
+ * @param dest_offset
+ * @param length
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioCopyBounce(int32_t source_desc, int64_t source_offset, int32_t dest_desc,
+                     int64_t dest_offset, int64_t length) {
+  int8_t* chunk  = (int8_t*)malloc(IO_CHUNK_SIZE);
+  int32_t status = EXIT_SUCCESS;
+
+  if (chunk == NULL) {
+    printf("io: ioCopyBounce(): error: Unable to allocate a %d byte chunk\n", IO_CHUNK_SIZE);
+    return EXIT_FAILURE;
+  }
+
+  for (int64_t done = 0; done < length && status == EXIT_SUCCESS; done += IO_CHUNK_SIZE) {
+    int64_t      chunk_length = length - done < IO_CHUNK_SIZE ? length - done : IO_CHUNK_SIZE;
+    struct iovec vector       = { chunk, chunk_length };
+
+    status = ioDescriptorVector(source_desc, &vector, 1, source_offset + done, IOMODE_READ);
+
+    if (status == EXIT_SUCCESS) {
+      vector = (struct iovec){ chunk, chunk_length };
+      status = ioDescriptorVector(dest_desc, &vector, 1, dest_offset + done, IOMODE_WRITE);
+    }
+  }
+
+  free(chunk);
+
+  return status;
+}
+
+/**
+ * @brief Copies bytes between two files inside the kernel with sendfile(), for kernels where
+ * copy_file_range() can't cross filesystems. Falls back to a bounce buffer when that fails too.
+ *
+ * @param source_desc
+ * @param source_offset
+ * @param dest_desc
+ * @param dest_offset
+ * @param length
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioCopySendfile(int32_t source_desc, int64_t source_offset, int32_t dest_desc,
+                       int64_t dest_offset, int64_t length) {
+  // sendfile() writes at the file position, callers only get here when nothing else moves it
+  if (lseek(dest_desc, dest_offset, SEEK_SET) < 0) {
+    return ioCopyBounce(source_desc, source_offset, dest_desc, dest_offset, length);
+  }
+
+  while (length > 0) {
+    off_t   source_pos = source_offset;
+    ssize_t done       = sendfile(dest_desc, source_desc, &source_pos, length);
+
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (done < 0 && (errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+      return ioCopyBounce(source_desc, source_offset, dest_desc, dest_offset, length);
+    }
+
+    if (done < 0) {
+      printf("io: ioCopySendfile(): error: Copy from %5ld to %5ld failed: %s\n", source_offset,
+             dest_offset, strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+    if (done == 0) {
+      printf("io: ioCopySendfile(): error: Unexpected end of file at %5ld\n", source_offset);
+      return EXIT_FAILURE;
+    }
+
+    source_offset += done;
+    dest_offset += done;
+    length -= done;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Copies bytes between two files inside the kernel with copy_file_range(), so the data
+ * never passes through this process. Falls back to sendfile() where the kernel or the
+ * filesystems involved can't do that. sendfile() writes at the file position, which threads
+ * writing to the same descriptor would move under each other, so a shared destination goes
+ * straight to the bounce buffer and its pwrite().
+ *
+ * @param source_desc
+ * @param source_offset
+ * @param dest_desc
+ * @param dest_offset
+ * @param length
+ * @param is_shared 1 when other threads write to dest_desc, e.g. the image
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioCopyRange(int32_t source_desc, int64_t source_offset, int32_t dest_desc,
+                    int64_t dest_offset, int64_t length, int8_t is_shared) {
+  while (length > 0) {
+    loff_t  source_pos = source_offset;
+    loff_t  dest_pos   = dest_offset;
+    ssize_t done = copy_file_range(source_desc, &source_pos, dest_desc, &dest_pos, length, 0);
+
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (done < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                     errno == EOPNOTSUPP || errno == EBADF)) {
+      return is_shared
+               ? ioCopyBounce(source_desc, source_offset, dest_desc, dest_offset, length)
+               : ioCopySendfile(source_desc, source_offset, dest_desc, dest_offset, length);
+    }
+
+    if (done < 0) {
+      printf("io: ioCopyRange(): error: Copy from %5ld to %5ld failed: %s\n", source_offset,
+             dest_offset, strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+    if (done == 0) {
+      printf("io: ioCopyRange(): error: Unexpected end of file at %5ld\n", source_offset);
+      return EXIT_FAILURE;
+    }
+
+    source_offset += done;
+    dest_offset += done;
+    length -= done;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Copies the data of one file into the blocks already allocated to another.
+ * Runs of blocks that are physically consecutive in both files are copied with one
+ * copy_file_range() call on the image, holes in the source become zeroed blocks.
+ *
+ * @param disk_info
+ * @param source File to copy
+ * @param dest File with at least as many blocks as length needs
+ * @param length Bytes to copy
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioFileCopy(DiskInfo* disk_info, INode* source, INode* dest, int64_t length) {
+  IndirectRange range       = calculateIndirectRange(disk_info);
+  int64_t       block_count = (length + disk_info->block_size - 1) / disk_info->block_size;
+
+  if (block_count > source->i_blocks || block_count > dest->i_blocks ||
+      block_count > range.triple_end) {
+    printf("io: ioFileCopy(): error: Requested to copy %5ld blocks between files of %5d and %5d "
+           "blocks\n",
+           block_count, source->i_blocks, dest->i_blocks);
+    return EXIT_FAILURE;
+  }
+
+  // The kernel copies what is on the disk, so it has to be current
+  if (cacheFlushBlocks(disk_info) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  for (int64_t block_pos = 0; block_pos < block_count;) {
+    int64_t run       = 1;  // Blocks copied in one go
+    int32_t source_no = 0;
+    int32_t dest_no   = 0;
+
+    ioFileBlockHelper(disk_info, &source_no, source, &range, block_pos);
+    ioFileBlockHelper(disk_info, &dest_no, dest, &range, block_pos);
+
+    if (dest_no == 0) {
+      printf("io: ioFileCopy(): error: Requested block 0\n");
+      return EXIT_FAILURE;
+    }
+
+    if (source_no == 0) {
+      // Holes read back as zeros
+      int8_t zeros[disk_info->block_size];
+      bzero(zeros, disk_info->block_size);
+
+      if (ioBlock(disk_info, dest_no, zeros, IOMODE_WRITE) == EXIT_FAILURE) {
+        return EXIT_FAILURE;
+      }
+
+      block_pos++;
+      continue;
+    }
+
+    // Grow the run while the next block sits right after it in both files
+    while (block_pos + run < block_count) {
+      int32_t next_source = 0;
+      int32_t next_dest   = 0;
+
+      ioFileBlockHelper(disk_info, &next_source, source, &range, block_pos + run);
+      ioFileBlockHelper(disk_info, &next_dest, dest, &range, block_pos + run);
+
+      if (next_source != source_no + run || next_dest != dest_no + run) {
+        break;
+      }
+
+      run++;
+    }
+
+    cacheDropBlocks(disk_info, dest_no, run);
+
+    if (ioCopyRange(disk_info->file_desc, source_no * disk_info->block_size, disk_info->file_desc,
+                    dest_no * disk_info->block_size, run * disk_info->block_size,
+                    1) == EXIT_FAILURE) {
+      return EXIT_FAILURE;
+    }
+    block_pos += run;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Moves the data of a file between the image and a file on the host. Each run of
+ * physically consecutive blocks is one copy_file_range() call between the two descriptors, holes
+ * are left for the host file to read back as zeros.
+ *
+ * @param disk_info
+ * @param inode File in the image, with all of its blocks allocated when writing
+ * @param host_desc Regular file on the host
+ * @param length Bytes to move
+ * @param mode IOMODE_READ copies the file out to the host, IOMODE_WRITE copies the host file in
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioFileHost(DiskInfo* disk_info, INode* inode, int32_t host_desc, int64_t length,
+                   IOMode mode) {
+  IndirectRange range       = calculateIndirectRange(disk_info);
+  int64_t       block_count = (length + disk_info->block_size - 1) / disk_info->block_size;
+
+  if (block_count > inode->i_blocks || block_count > range.triple_end) {
+    printf("io: ioFileHost(): error: Requested %5ld blocks when there are only %5d blocks\n",
+           block_count, inode->i_blocks);
+    return EXIT_FAILURE;
+  }
+
+  if (mode == IOMODE_READ) {
+    // Sizing the host file up front leaves the holes zeroed
+    if (ftruncate(host_desc, length) != 0) {
+      printf("io: ioFileHost(): error: Unable to size host file: %s\n", strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+    // The kernel copies what is on the disk, so it has to be current
+    if (cacheFlushBlocks(disk_info) == EXIT_FAILURE) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (int64_t block_pos = 0; block_pos < block_count;) {
+    int64_t run      = 1;  // Blocks moved in one go
+    int32_t block_no = 0;
+
+    ioFileBlockHelper(disk_info, &block_no, inode, &range, block_pos);
+
+    if (block_no == 0) {
+      if (mode == IOMODE_WRITE) {
+        printf("io: ioFileHost(): error: Requested block 0\n");
+        return EXIT_FAILURE;
+      }
+
+      block_pos++;
+      continue;
+    }
+
+    // Grow the run while the next block sits right after it on the disk
+    while (block_pos + run < block_count) {
+      int32_t next_no = 0;
+      ioFileBlockHelper(disk_info, &next_no, inode, &range, block_pos + run);
+
+      if (next_no != block_no + run) {
+        break;
+      }
+
+      run++;
+    }
+
+    int64_t host_offset = block_pos * disk_info->block_size;
+    int64_t disk_offset = block_no * disk_info->block_size;
+    int64_t run_length  = run * disk_info->block_size;
+
+    // The last block of the file is only partly used
+    if (host_offset + run_length > length) {
+      run_length = length - host_offset;
+    }
+
+    if (mode == IOMODE_WRITE) {
+      cacheDropBlocks(disk_info, block_no, run);
+    }
+
+    int32_t status =
+      mode == IOMODE_READ
+        ? ioCopyRange(disk_info->file_desc, disk_offset, host_desc, host_offset, run_length, 0)
+        : ioCopyRange(host_desc, host_offset, disk_info->file_desc, disk_offset, run_length, 1);
+
+    if (status == EXIT_FAILURE) {
+      return EXIT_FAILURE;
+    }
+
+    block_pos += run;
+  }
+
+  // Whatever the last block held past the end of the file is cleared
+  if (mode == IOMODE_WRITE && length % disk_info->block_size != 0) {
+    int64_t tail_length = disk_info->block_size - length % disk_info->block_size;
+    int8_t  zeros[tail_length];
+    bzero(zeros, tail_length);
+
+    return ioFile(disk_info, zeros, inode, tail_length, length, IOMODE_WRITE);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Writes everything held in memory back to the disk
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioFlush(DiskInfo* disk_info) {
+  BitmapCache* bitmap_cache = disk_info->bitmap_cache;
+
+  // Bitmaps are written back in batches, they land in blocks so they go before the blocks
+  if (time(NULL) - bitmap_cache->last_flush >= bitmap_cache->flush_interval &&
+      cacheFlushBitmaps(disk_info) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  // INodes land in INode table blocks, so they have to go before the blocks are flushed
+  if (cacheFlushINodes(disk_info) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  if (disk_info->group_descs_dirty &&
+      ioGroupDescriptorTable(disk_info, IOMODE_WRITE) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  if (disk_info->backend == DISK_BACKEND_MMAP) {
+    msync(disk_info->map, disk_info->map_length, MS_ASYNC);
+    return EXIT_SUCCESS;
+  }
+
+  return cacheFlushBlocks(disk_info);
+}
+
+/**
+ * @brief Writes everything held in memory back to the disk, including bitmaps that are still
+ * waiting for their flush interval. Preallocated blocks nothing has used yet are given back first.
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioSync(DiskInfo* disk_info) {
+  cacheReleaseWindows(disk_info);
+
+  if (cacheFlushBitmaps(disk_info) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
+  }
+
+  return ioFlush(disk_info);
+}
+
+/**
+ * @brief Writes everything held in memory back to the disk and stops. Bitmaps, INodes and blocks
+ * are written back lazily, exiting without this would leave the image half updated.
+ *
+ * @param disk_info
+ */
+void ioAbort(DiskInfo* disk_info) {
+  ioSync(disk_info);
+  exit(EXIT_FAILURE);
+}
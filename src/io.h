@@ -1,16 +1,25 @@
 #ifndef IO_H
 #define IO_H
 
+#include "cache.h"
 #include "types.h"
 #include "utility.h"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
-enum IOMode { IOMODE_READ, IOMODE_WRITE } typedef IOMode;
+/**
+ * @brief Access pattern hints for a range of blocks
+ */
+enum IOAdvice { IOADVICE_SEQUENTIAL, IOADVICE_RANDOM } typedef IOAdvice;
 
 /**
  * @brief Keeps track of the indirect block names
@@ -20,25 +29,99 @@ enum IOMode { IOMODE_READ, IOMODE_WRITE } typedef IOMode;
 #define EXT2_INDIRECT_TRIPLE 14
 
 /**
- * @brief Does an IO operation on a sequence of bytes on the disk
+ * @brief Most buffers handed to a single preadv / pwritev call (the Linux UIO_MAXIOV)
+ */
+#define IO_VECTOR_MAX 1024
+
+/**
+ * @brief Bytes of a file read at a time when streaming it, a multiple of every block size
+ */
+#define IO_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Maps the whole disk image into memory and switches the disk to the mmap backend
+ *
+ * @param disk_info
+ */
+void ioMapDisk(DiskInfo* disk_info);
+
+/**
+ * @brief Gets a pointer straight into the mapped image for a block
+ *
+ * @param disk_info
+ * @param block
+ * @return int8_t* NULL unless the disk uses the mmap backend
+ */
+int8_t* ioBlockPointer(DiskInfo* disk_info, int64_t block);
+
+/**
+ * @brief Hints how a range of blocks is about to be accessed. Only the mmap backend uses hints.
+ *
+ * @param disk_info
+ * @param block
+ * @param count
+ * @param advice
+ */
+void ioAdvise(DiskInfo* disk_info, int64_t block, int64_t count, IOAdvice advice);
+
+/**
+ * @brief Does an IO operation on buffers that are contiguous in a file with preadv / pwritev
+ *
+ * @param file_desc
+ * @param vectors
+ * @param count
+ * @param offset
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioDescriptorVector(int32_t file_desc, struct iovec* vectors, int32_t count, int64_t offset,
+                           IOMode mode);
+
+/**
+ * @brief Does an IO operation on buffers that are contiguous on the disk with preadv / pwritev
+ *
+ * @param disk_info
+ * @param vectors
+ * @param count
+ * @param offset
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioBytesVector(DiskInfo* disk_info, struct iovec* vectors, int32_t count, int64_t offset,
+                      IOMode mode);
+
+/**
+ * @brief Does an IO operation on a sequence of bytes on the disk with pread / pwrite
  *
  * @param disk_info
  * @param buffer
  * @param length
  * @param offset
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioBytes(DiskInfo* disk_info, int8_t* buffer, int64_t length, int64_t offset, IOMode mode);
+int32_t ioBytes(DiskInfo* disk_info, int8_t* buffer, int64_t length, int64_t offset, IOMode mode);
 
 /**
- * @brief Does an IO operation on a block
+ * @brief Does an IO operation on a block through the block cache
  *
  * @param disk_info
  * @param block
  * @param buffer
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, IOMode mode);
+
+/**
+ * @brief Zeroes a run of blocks on the disk, punching a hole in the image where possible
+ *
+ * @param disk_info
+ * @param block
+ * @param count
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, IOMode mode);
+int32_t ioZeroBlocks(DiskInfo* disk_info, int64_t block, int64_t count);
 
 /**
  * @brief Does an IO operation on a portion of a block
@@ -49,43 +132,103 @@ void ioBlock(DiskInfo* disk_info, int64_t block, int8_t* buffer, IOMode mode);
  * @param length
  * @param offset
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioBlockPart(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t length, int64_t offset,
-                 IOMode mode);
+int32_t ioBlockPart(DiskInfo* disk_info, int8_t* buffer, int64_t block, int64_t length,
+                    int64_t offset, IOMode mode);
 
 /**
- * @brief Does an IO operation on a group descriptor
+ * @brief Does an IO operation on the whole group descriptor table held in disk_info
+ *
+ * @param disk_info
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioGroupDescriptorTable(DiskInfo* disk_info, IOMode mode);
+
+/**
+ * @brief Does an IO operation on the in-memory copy of a group descriptor
  *
  * @param disk_info
  * @param group
  * @param group_no
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioGroupDescriptor(DiskInfo* disk_info, GroupDesc* group, int64_t group_no, IOMode mode);
+int32_t ioGroupDescriptor(DiskInfo* disk_info, GroupDesc* group, int64_t group_no, IOMode mode);
 
 /**
- * @brief Does an IO operation on an INode
+ * @brief Does an IO operation on an INode directly in its INode table, bypassing the INode cache
  *
  * @param disk_info
  * @param inode
  * @param inode_no
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-void ioINode(DiskInfo* disk_info, INode* inode, int64_t inode_no, IOMode mode);
+int32_t ioINodeTable(DiskInfo* disk_info, INode* inode, int64_t inode_no, IOMode mode);
 
 /**
- * @brief Does an IO operation on a directory entry
+ * @brief Does an IO operation on an INode through the INode cache
+ *
+ * @param disk_info
+ * @param inode
+ * @param inode_no
+ * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioINode(DiskInfo* disk_info, INode* inode, int64_t inode_no, IOMode mode);
+
+/**
+ * @brief Does an IO operation on a whole block of a directory
  *
  * @param disk_info
- * @param directory
  * @param inode
- * @param offset in bytes
+ * @param block_pos
+ * @param buffer
  * @param mode
- * @return int64_t offset in bytes after seeking is done
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
  */
-int64_t ioDirectoryEntry(DiskInfo* disk_info, Directory* directory, INode* inode, int64_t offset,
+int32_t ioDirectoryBlock(DiskInfo* disk_info, INode* inode, int64_t block_pos, int8_t* buffer,
                          IOMode mode);
 
+/**
+ * @brief Starts walking the entries of a directory
+ *
+ * @param disk_info
+ * @param iterator
+ * @param inode_no
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioDirectoryOpen(DiskInfo* disk_info, DirectoryIterator* iterator, int64_t inode_no);
+
+/**
+ * @brief Reads the next used entry of a directory
+ *
+ * @param disk_info
+ * @param iterator
+ * @param directory
+ * @return int32_t EXIT_SUCCESS, or EXIT_FAILURE once there are no more entries
+ */
+int32_t ioDirectoryNext(DiskInfo* disk_info, DirectoryIterator* iterator, Directory* directory);
+
+/**
+ * @brief Stops walking a directory
+ *
+ * @param iterator
+ */
+void ioDirectoryClose(DirectoryIterator* iterator);
+
+/**
+ * @brief Reads one block number out of an indirect block
+ *
+ * @param disk_info
+ * @param block
+ * @param index
+ * @return int32_t
+ */
+int32_t ioIndirectBlock(DiskInfo* disk_info, int64_t block, int32_t index);
+
 /**
  * @brief Reads data from an INode in order
  *
@@ -98,6 +241,18 @@ int64_t ioDirectoryEntry(DiskInfo* disk_info, Directory* directory, INode* inode
 void ioFileBlockHelper(DiskInfo* disk_info, int32_t* block_no, INode* inode, IndirectRange* range,
                        int64_t block_pos);
 
+/**
+ * @brief Hints that a range of a file's blocks is about to be read sequentially
+ *
+ * @param disk_info
+ * @param inode
+ * @param range
+ * @param first_block
+ * @param block_count
+ */
+void ioAdviseFile(DiskInfo* disk_info, INode* inode, IndirectRange* range, int64_t first_block,
+                  int64_t block_count);
+
 /**
  * @brief Does an IO operation on a file (really, just the data in an INode)
  *
@@ -107,8 +262,114 @@ void ioFileBlockHelper(DiskInfo* disk_info, int32_t* block_no, INode* inode, Ind
  * @param length
  * @param offset
  * @param mode
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioFile(DiskInfo* disk_info, int8_t* buffer, INode* inode, int64_t length, int64_t offset,
+               IOMode mode);
+
+/**
+ * @brief Reads a file in order, handing each chunk to a handler as soon as it is read
+ *
+ * @param disk_info
+ * @param inode File to read
+ * @param handler
+ * @param context Passed through to the handler
+ * @return int32_t EXIT_FAILURE on an IO error or when the handler stops early
+ */
+int32_t ioFileChunks(DiskInfo* disk_info, INode* inode, FileChunkHandler handler,
+                     void* context);
+
+/**
+ * @brief Copies bytes between two files with a bounce buffer
+ *
+ * @param source_desc
+ * @param source_offset
+ * @param dest_desc
+ * @param dest_offset
+ * @param length
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioCopyBounce(int32_t source_desc, int64_t source_offset, int32_t dest_desc,
+                     int64_t dest_offset, int64_t length);
+
+/**
+ * @brief Copies bytes between two files with sendfile(), falling back to a bounce buffer
+ *
+ * @param source_desc
+ * @param source_offset
+ * @param dest_desc
+ * @param dest_offset
+ * @param length
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioCopySendfile(int32_t source_desc, int64_t source_offset, int32_t dest_desc,
+                       int64_t dest_offset, int64_t length);
+
+/**
+ * @brief Copies bytes between two files inside the kernel, falling back to sendfile() when
+ * nothing else writes to the destination, or else to a bounce buffer
+ *
+ * @param source_desc
+ * @param source_offset
+ * @param dest_desc
+ * @param dest_offset
+ * @param length
+ * @param is_shared 1 when other threads write to dest_desc, e.g. the image
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioCopyRange(int32_t source_desc, int64_t source_offset, int32_t dest_desc,
+                    int64_t dest_offset, int64_t length, int8_t is_shared);
+
+/**
+ * @brief Copies the data of one file into the blocks already allocated to another without it
+ * passing through user space
+ *
+ * @param disk_info
+ * @param source
+ * @param dest
+ * @param length
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioFileCopy(DiskInfo* disk_info, INode* source, INode* dest, int64_t length);
+
+/**
+ * @brief Copies a file out of the image to the host, or into the image from the host, without
+ * the data passing through user space
+ *
+ * @param disk_info
+ * @param inode
+ * @param host_desc
+ * @param length
+ * @param mode IOMODE_READ to copy out, IOMODE_WRITE to copy in
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioFileHost(DiskInfo* disk_info, INode* inode, int32_t host_desc, int64_t length,
+                   IOMode mode);
+
+/**
+ * @brief Writes all cached changes back to the disk. Bitmaps are only written once their flush
+ * interval has passed.
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioFlush(DiskInfo* disk_info);
+
+/**
+ * @brief Writes all cached changes back to the disk, without waiting for the bitmap flush
+ * interval
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t ioSync(DiskInfo* disk_info);
+
+/**
+ * @brief Writes everything held in memory back to the disk and stops. For errors in the middle of
+ * a change that can't be backed out, so the image keeps what was done so far.
+ *
+ * @param disk_info
  */
-void ioFile(DiskInfo* disk_info, int8_t* buffer, INode* inode, int64_t length, int64_t offset,
-            IOMode mode);
+void ioAbort(DiskInfo* disk_info);
 
 #endif
\ No newline at end of file
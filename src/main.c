@@ -12,6 +12,9 @@
 void initalizeState(State* state) {
   initializeFilesystem(state->disk_info, state->ext_info);
 
+  // Finish freeing whatever a previous run left orphaned
+  orphanInitialize(state->disk_info, state->ext_info->super_block.s_last_orphan);
+
   state->user.user_id  = getuid();
   state->user.group_id = getgid();
 
@@ -21,6 +24,11 @@ void initalizeState(State* state) {
 
   state->path_root = root_path;
   state->path_cwd  = root_path;
+
+  // Root and the working directory are looked up constantly, keep them in the INode cache. Each
+  // holds its own pin, cd drops the working directory's.
+  cachePinINode(state->disk_info, state->path_root->inode_number);
+  cachePinINode(state->disk_info, state->path_cwd->inode_number);
 }
 
 /**
@@ -33,7 +41,10 @@ uint32_t grabCommand(char parameter[EXT2_NAME_LEN]) {
   char command[EXT2_NAME_LEN] = { 0 };
   char buffer[EXT2_NAME_LEN]  = { 0 };
 
-  scanf("%[^\n]%*c", buffer);
+  // Nothing is read at the end of input, which leaves an empty command
+  if (fgets(buffer, EXT2_NAME_LEN, stdin) != NULL) {
+    buffer[strcspn(buffer, "\n")] = '\0';
+  }
 
   // Split the string, dump part after command into parameter
   for (int32_t pos = 0; pos < EXT2_NAME_LEN; pos++) {
@@ -68,26 +79,49 @@ uint32_t grabCommand(char parameter[EXT2_NAME_LEN]) {
  * @param argv
  */
 int32_t main(int32_t argc, char** argv) {
-  ExtInfo  ext_info;
-  DiskInfo disk_info;
-
-  if (argc < 1) {
-    printf("Please provide a disk image\n");
+  ExtInfo     ext_info;
+  DiskInfo    disk_info = { 0 };
+  DiskBackend backend   = DISK_BACKEND_FD;
+  int32_t     interval  = BITMAP_FLUSH_INTERVAL;
+  int8_t      zero      = 1;
+
+  if (argc < 2) {
+    printf("Usage: %s <disk image> [--mmap] [--flush-interval <seconds>] [--keep-freed]\n", *argv);
     return EXIT_FAILURE;
   }
 
+  for (int32_t pos = 2; pos < argc; pos++) {
+    if (strcmp(argv[pos], "--mmap") == 0) {
+      backend = DISK_BACKEND_MMAP;
+    } else if (strcmp(argv[pos], "--flush-interval") == 0 && pos + 1 < argc) {
+      interval = atoi(argv[++pos]);
+    } else if (strcmp(argv[pos], "--keep-freed") == 0) {
+      zero = 0;
+    } else {
+      printf("Unknown option=%s\n", argv[pos]);
+      return EXIT_FAILURE;
+    }
+  }
+
   printf("Mounting disk=%s\n", *(argv + 1));
 
   disk_info.file_desc = open(*(argv + 1), O_RDWR);
 
-  if (disk_info.file_desc == 0) {
+  if (disk_info.file_desc < 0) {
     printf("Unable to open file=%s\n", *(argv + 1));
     return EXIT_FAILURE;
   }
 
+  if (backend == DISK_BACKEND_MMAP) {
+    ioMapDisk(&disk_info);
+  }
+
   State state = { &ext_info, &disk_info };
   initalizeState(&state);
 
+  disk_info.bitmap_cache->flush_interval = interval;
+  disk_info.zero_freed                   = zero;
+
   uint32_t command_id;
   char     parameter[EXT2_NAME_LEN];
 
@@ -101,13 +135,27 @@ int32_t main(int32_t argc, char** argv) {
     printf("gid=%d uid=%d> ", state.user.group_id, state.user.user_id);
     command_id = grabCommand(parameter);
 
+    // Out of input, so write everything back and stop
+    if (command_id == (uint32_t)-1 && feof(stdin)) {
+      printf("\n");
+      break;
+    }
+
     if (command_id > kCommandCount) {
       printf("shell: command not found\n");
       continue;
     }
 
-    // Run the command
     runCommand(&state, (Command)command_id, parameter);
+
+    // Write back whatever the command left in the caches
+    ioFlush(&disk_info);
+  }
+
+  orphanStop(&disk_info);
+
+  if (ioSync(&disk_info) == EXIT_FAILURE) {
+    return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,239 @@
+#include "orphan.h"
+
+/**
+ * @brief Writes the first orphan to the superblock so the chain survives a restart
+ *
+ * @param disk_info
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t orphanWriteHead(DiskInfo* disk_info) {
+  uint32_t head = disk_info->orphans->head;
+
+  return ioBytes(disk_info, (int8_t*)&head, sizeof(uint32_t),
+                 SUPERBLOCK_OFFSET + offsetof(struct ext2_super_block, s_last_orphan),
+                 IOMODE_WRITE);
+}
+
+/**
+ * @brief Sets up the orphan list and starts the reclaimer. The chain left by a previous run is
+ * walked to count what is still to do, a chain that points somewhere odd is cut off there.
+ *
+ * @param disk_info
+ * @param last_orphan
+ */
+void orphanInitialize(DiskInfo* disk_info, int64_t last_orphan) {
+  OrphanList* orphans = (OrphanList*)calloc(1, sizeof(OrphanList));
+
+  if (orphans == NULL) {
+    printf("orphan: orphanInitialize(): error: Unable to allocate the orphan list\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_mutex_init(&orphans->lock, NULL);
+  pthread_cond_init(&orphans->wake, NULL);
+  orphans->head      = last_orphan;
+  disk_info->orphans = orphans;
+
+  int64_t previous = 0;
+
+  for (int64_t inode_no = last_orphan; inode_no != 0;) {
+    INode inode;
+
+    if (inode_no < EXT2_ROOT_INO || inode_no > disk_info->inode_count ||
+        orphans->pending >= disk_info->inode_count ||
+        ioINode(disk_info, &inode, inode_no, IOMODE_READ) == EXIT_FAILURE) {
+      printf("orphan: orphanInitialize(): error: Orphan chain is broken at INode %ld\n", inode_no);
+
+      // Keep what was walked so far
+      if (previous == 0) {
+        orphans->head = 0;
+        orphanWriteHead(disk_info);
+      } else {
+        ioINode(disk_info, &inode, previous, IOMODE_READ);
+        inode.i_dtime = 0;
+        ioINode(disk_info, &inode, previous, IOMODE_WRITE);
+      }
+
+      break;
+    }
+
+    orphans->pending++;
+    previous = inode_no;
+    inode_no = inode.i_dtime;
+  }
+
+  if (orphans->pending > 0) {
+    printf("Finishing %ld orphaned INodes in the background\n", orphans->pending);
+  }
+
+  if (pthread_create(&orphans->thread, NULL, orphanReclaim, disk_info) != 0) {
+    printf("orphan: orphanInitialize(): error: Unable to start the reclaimer\n");
+    exit(EXIT_FAILURE);
+  }
+
+  orphans->running = 1;
+}
+
+/**
+ * @brief Puts an INode on the front of the orphan chain and wakes the reclaimer
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void orphanAdd(DiskInfo* disk_info, int64_t inode_no) {
+  OrphanList* orphans = disk_info->orphans;
+  INode       inode;
+
+  pthread_mutex_lock(&orphans->lock);
+
+  ioINode(disk_info, &inode, inode_no, IOMODE_READ);
+  inode.i_links_count = 0;
+  inode.i_dtime       = orphans->head;
+  ioINode(disk_info, &inode, inode_no, IOMODE_WRITE);
+
+  orphans->head = inode_no;
+  orphans->pending++;
+  orphanWriteHead(disk_info);
+
+  pthread_cond_signal(&orphans->wake);
+  pthread_mutex_unlock(&orphans->lock);
+}
+
+/**
+ * @brief Takes an INode off the orphan chain, wherever it is on it
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void orphanRemove(DiskInfo* disk_info, int64_t inode_no) {
+  OrphanList* orphans = disk_info->orphans;
+  INode       inode;
+
+  ioINode(disk_info, &inode, inode_no, IOMODE_READ);
+
+  if (orphans->head == inode_no) {
+    orphans->head = inode.i_dtime;
+    orphanWriteHead(disk_info);
+  } else {
+    for (int64_t previous = orphans->head; previous != 0;) {
+      INode previous_inode;
+      ioINode(disk_info, &previous_inode, previous, IOMODE_READ);
+
+      if (previous_inode.i_dtime == inode_no) {
+        previous_inode.i_dtime = inode.i_dtime;
+        ioINode(disk_info, &previous_inode, previous, IOMODE_WRITE);
+        break;
+      }
+
+      previous = previous_inode.i_dtime;
+    }
+  }
+
+  inode.i_dtime = 0;
+  ioINode(disk_info, &inode, inode_no, IOMODE_WRITE);
+
+  if (orphans->pending > 0) {
+    orphans->pending--;
+  }
+}
+
+/**
+ * @brief Body of the reclaimer thread. Takes the first orphan, unhooks its blocks from the INode
+ * and frees them ORPHAN_RECLAIM_SLICE at a time. The orphan lock is only held to look at the
+ * chain, the blocks are freed under the locks of their groups like any other. The INode itself
+ * goes last.
+ *
+ * @param argument DiskInfo
+ * @return void*
+ */
+void* orphanReclaim(void* argument) {
+  DiskInfo*   disk_info = (DiskInfo*)argument;
+  OrphanList* orphans   = disk_info->orphans;
+
+  pthread_mutex_lock(&orphans->lock);
+
+  while (1) {
+    while (orphans->head == 0 && !orphans->stopping) {
+      pthread_cond_wait(&orphans->wake, &orphans->lock);
+    }
+
+    if (orphans->head == 0) {
+      break;
+    }
+
+    int64_t   inode_no = orphans->head;
+    BlockList list     = { NULL, 0, 0 };
+    INode     inode;
+
+    orphans->current     = inode_no;
+    orphans->blocks_left = 0;
+    pthread_mutex_unlock(&orphans->lock);
+
+    // Whoever was still reading the file when its last name went finishes first
+    cacheLockINode(disk_info, inode_no);
+    ioINode(disk_info, &inode, inode_no, IOMODE_READ);
+
+    for (int32_t pos = 0; pos < EXT2_INDIRECT_SINGLE; pos++) {
+      deallocateListTree(disk_info, &list, inode.i_block[pos], 0);
+    }
+
+    deallocateListTree(disk_info, &list, inode.i_block[EXT2_INDIRECT_SINGLE], 1);
+    deallocateListTree(disk_info, &list, inode.i_block[EXT2_INDIRECT_DOUBLE], 2);
+    deallocateListTree(disk_info, &list, inode.i_block[EXT2_INDIRECT_TRIPLE], 3);
+
+    // Once the INode lets go of its blocks, a reclaim cut short only leaks them
+    bzero(inode.i_block, sizeof(inode.i_block));
+    inode.i_blocks = 0;
+    ioINode(disk_info, &inode, inode_no, IOMODE_WRITE);
+    cacheUnlockINode(disk_info, inode_no);
+
+    qsort(list.blocks, list.count, sizeof(int64_t), deallocateCompareBlocks);
+
+    for (int64_t pos = 0; pos < list.count;) {
+      pos = deallocateBlockRuns(disk_info, &list, pos, ORPHAN_RECLAIM_SLICE);
+
+      pthread_mutex_lock(&orphans->lock);
+      orphans->blocks_left = list.count - pos;
+      pthread_mutex_unlock(&orphans->lock);
+    }
+
+    free(list.blocks);
+
+    pthread_mutex_lock(&orphans->lock);
+    orphans->reclaimed_blocks += list.count;
+    orphanRemove(disk_info, inode_no);
+    pthread_mutex_unlock(&orphans->lock);
+
+    deallocateINode(disk_info, inode_no);
+    ioFlush(disk_info);
+
+    pthread_mutex_lock(&orphans->lock);
+    orphans->current = 0;
+    orphans->reclaimed_inodes++;
+  }
+
+  pthread_mutex_unlock(&orphans->lock);
+
+  return NULL;
+}
+
+/**
+ * @brief Waits for the reclaimer to empty the orphan chain, then stops it
+ *
+ * @param disk_info
+ */
+void orphanStop(DiskInfo* disk_info) {
+  OrphanList* orphans = disk_info->orphans;
+
+  if (!orphans->running) {
+    return;
+  }
+
+  pthread_mutex_lock(&orphans->lock);
+  orphans->stopping = 1;
+  pthread_cond_signal(&orphans->wake);
+  pthread_mutex_unlock(&orphans->lock);
+
+  pthread_join(orphans->thread, NULL);
+  orphans->running = 0;
+}
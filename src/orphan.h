@@ -0,0 +1,59 @@
+#ifndef ORPHAN_H
+#define ORPHAN_H
+
+#include "alloc.h"
+#include "io.h"
+#include "types.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * @brief Blocks the reclaimer frees between updates of its progress
+ */
+#define ORPHAN_RECLAIM_SLICE 4096
+
+/**
+ * @brief Sets up the orphan list and starts the reclaimer. Orphans a previous run left on the
+ * chain are picked up and finished in the background.
+ *
+ * @param disk_info
+ * @param last_orphan s_last_orphan from the superblock
+ */
+void orphanInitialize(DiskInfo* disk_info, int64_t last_orphan);
+
+/**
+ * @brief Puts an INode whose last link is gone on the orphan chain, its blocks are freed in the
+ * background. Must be called with the INode locked.
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void orphanAdd(DiskInfo* disk_info, int64_t inode_no);
+
+/**
+ * @brief Takes an INode off the orphan chain. Must be called with the orphan lock held.
+ *
+ * @param disk_info
+ * @param inode_no
+ */
+void orphanRemove(DiskInfo* disk_info, int64_t inode_no);
+
+/**
+ * @brief Body of the reclaimer thread
+ *
+ * @param argument DiskInfo
+ * @return void*
+ */
+void* orphanReclaim(void* argument);
+
+/**
+ * @brief Waits for the reclaimer to empty the orphan chain, then stops it
+ *
+ * @param disk_info
+ */
+void orphanStop(DiskInfo* disk_info);
+
+#endif
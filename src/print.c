@@ -31,6 +31,17 @@ void printDiskInfomation(ExtInfo* ext_info, DiskInfo* disk_info) {
   printf("%17s: %10u\n", "First INode", ext_info->super_block.s_first_ino);
   printf("%17s: %10lu\n", "Free INodes", disk_info->free_inodes);
   printf("%17s: %10u\n", "INodes per Group", ext_info->super_block.s_inodes_per_group);
+  printf("%17s: %10li\n", "Block Cache Hits", disk_info->block_cache->hits);
+  printf("%17s: %10li\n", "Block Cache Miss", disk_info->block_cache->misses);
+  printf("%17s: %10li\n", "INode Cache Hits", disk_info->inode_cache->hits);
+  printf("%17s: %10li\n", "INode Cache Miss", disk_info->inode_cache->misses);
+  printf("%17s: %10li\n", "Dentry Cache Hits", disk_info->dentry_cache->hits);
+  printf("%17s: %10li\n", "Dentry Cache Miss", disk_info->dentry_cache->misses);
+  printf("%17s: %10li\n", "Map Cache Hits", disk_info->block_map_cache->hits);
+  printf("%17s: %10li\n", "Map Cache Miss", disk_info->block_map_cache->misses);
+  printf("%17s: %10li\n", "Bitmap Writes", disk_info->bitmap_cache->writes);
+  printf("%17s: %10li\n", "Preallocated", disk_info->prealloc_cache->reserved);
+  printf("%17s: %10li\n", "Prealloc Hits", disk_info->prealloc_cache->hits);
 }
 
 /**
@@ -126,26 +137,18 @@ void printINode(INode* inode) {
  * @param inode_start
  */
 void printDirectoryTable(DiskInfo* disk_info, int32_t inode_start) {
-  INode     root_inode;
-  Directory root_dir;
-  int64_t   directory_offset = 0;
+  DirectoryIterator iterator;
+  Directory         root_dir;
 
-  ioINode(disk_info, &root_inode, inode_start, IOMODE_READ);
-
-  while (1) {
-    if (directory_offset % 4 != 0) {
-      directory_offset += 4 - (directory_offset % 4);
-    }
-
-    directory_offset +=
-      ioDirectoryEntry(disk_info, &root_dir, &root_inode, directory_offset, IOMODE_READ);
-
-    if (isEndDirectory(&root_dir)) {
-      break;
-    }
+  if (ioDirectoryOpen(disk_info, &iterator, inode_start) == EXIT_FAILURE) {
+    return;
+  }
 
+  while (ioDirectoryNext(disk_info, &iterator, &root_dir) == EXIT_SUCCESS) {
     printDirectory(disk_info, &root_dir);
   }
+
+  ioDirectoryClose(&iterator);
 }
 
 /**
@@ -172,17 +175,30 @@ void printBitmap(int8_t bitmap) {
 }
 
 /**
- * @brief Prints a file
+ * @brief Writes a chunk of a file to stdout
  *
- * @param disk_info
- * @param file
+ * @param chunk
+ * @param length
+ * @param context unused
+ * @return int32_t
  */
-void printFile(DiskInfo* disk_info, INode* file) {
-  int8_t* seriously_the_entire_file = (int8_t*)calloc(sizeof(int8_t), file->i_size);
+int32_t printFileChunk(int8_t* chunk, int64_t length, void* context) {
+  if (fwrite(chunk, sizeof(int8_t), length, stdout) != length) {
+    return EXIT_FAILURE;
+  }
 
-  ioFile(disk_info, seriously_the_entire_file, file, file->i_size, 0, IOMODE_READ);
+  // Show each chunk as soon as it's read
+  fflush(stdout);
 
-  printf("%s", seriously_the_entire_file);
+  return EXIT_SUCCESS;
+}
 
-  free(seriously_the_entire_file);
-}
\ No newline at end of file
+/**
+ * @brief Prints a file, streaming it one chunk at a time
+ *
+ * @param disk_info
+ * @param file
+ */
+void printFile(DiskInfo* disk_info, INode* file) {
+  ioFileChunks(disk_info, file, printFileChunk, NULL);
+}
@@ -13,7 +13,8 @@
 static const char* kPrintCommands[] = { "ls",       "mkdir", "rmdir", "create",      "link",
                                         "unlink",   "mkfs",  "cat",   "cp",          "help",
                                         "cd",       "disk",  "inode", "blockbitmap", "inodebitmap",
-                                        "rawblock", "pwd" };
+                                        "rawblock", "pwd",   "put",   "get",         "sync",
+                                        "status",   "du",    "find",  "tree" };
 
 /**
  * @brief Count of commands
@@ -69,6 +70,16 @@ void printBitmap(int8_t bitmap);
  */
 void printGroupDesc(GroupDesc* group_desc);
 
+/**
+ * @brief Writes a chunk of a file to stdout
+ *
+ * @param chunk
+ * @param length
+ * @param context
+ * @return int32_t
+ */
+int32_t printFileChunk(int8_t* chunk, int64_t length, void* context);
+
 /**
  * @brief Prints a file
  *
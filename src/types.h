@@ -2,6 +2,9 @@
 #define TYPES_H
 
 #include <ext2fs/ext2_fs.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 
 /**
  * @brief Filesystem perm constants
@@ -46,23 +49,370 @@ typedef struct ext2_inode          INode;
 typedef struct ext2_group_desc     GroupDesc;
 typedef struct ext2_dir_entry_2    Directory;
 typedef struct ext2_dir_entry_tail DirectoryTail;
+typedef struct ext2_dx_root_info   DXRootInfo;
+typedef struct ext2_dx_entry       DXEntry;
+typedef struct ext2_dx_countlimit  DXCountLimit;
+
+/**
+ * @brief Deepest a directory index goes, counting the root
+ */
+#define HTREE_MAX_DEPTH 2
+
+/**
+ * @brief A single block held by the block cache
+ */
+typedef struct block_cache_entry {
+  int64_t block;
+  int32_t next;  // Next entry in the same hash bucket, or -1
+  int8_t  valid;
+  int8_t  dirty;
+  int8_t  referenced;
+} BlockCacheEntry;
+
+/**
+ * @brief Fixed-capacity cache of disk blocks keyed by block number.
+ * Entries are evicted with the CLOCK algorithm and dirty entries are written back on eviction or
+ * on flush. Everything in it is guarded by lock.
+ */
+typedef struct block_cache {
+  BlockCacheEntry* entries;
+  int32_t*         buckets;
+  int8_t*          data;
+  int32_t          capacity;
+  int32_t          bucket_count;
+  int32_t          used;
+  int32_t          clock_hand;
+  int64_t          hits;
+  int64_t          misses;
+  pthread_mutex_t  lock;
+} BlockCache;
+
+/**
+ * @brief A single INode held by the INode cache
+ */
+typedef struct inode_cache_entry {
+  INode   inode;
+  int64_t inode_no;
+  int32_t next;  // Next entry in the same hash bucket, or -1
+  int32_t pins;  // Pinned entries are never evicted
+  int8_t  valid;
+  int8_t  dirty;
+  int8_t  referenced;
+} INodeCacheEntry;
+
+/**
+ * @brief Fixed-capacity cache of INodes keyed by INode number.
+ * Dirty INodes are written back to their INode table blocks on eviction or on flush. The cache is
+ * guarded by lock, each INode's own lock keeps writers of the same file or directory apart.
+ */
+typedef struct inode_cache {
+  INodeCacheEntry*  entries;
+  int32_t*          buckets;
+  int32_t           capacity;
+  int32_t           bucket_count;
+  int32_t           used;
+  int32_t           clock_hand;
+  int64_t           hits;
+  int64_t           misses;
+  pthread_mutex_t   lock;
+  pthread_mutex_t** inode_locks;  // Per INode number, made the first time the INode is locked
+} INodeCache;
+
+/**
+ * @brief A cached directory lookup. An INode of 0 records that the name does not exist.
+ */
+typedef struct dentry_cache_entry {
+  int64_t parent;
+  int32_t inode;
+  int32_t next;  // Next entry in the same hash bucket, or -1
+  uint8_t file_type;
+  uint8_t name_len;
+  int8_t  valid;
+  int8_t  referenced;
+  char    name[EXT2_NAME_LEN];
+} DentryCacheEntry;
+
+/**
+ * @brief Fixed-capacity cache of (parent INode, name) -> (INode, file type) lookups, guarded by
+ * lock
+ */
+typedef struct dentry_cache {
+  DentryCacheEntry* entries;
+  int32_t*          buckets;
+  int32_t           capacity;
+  int32_t           bucket_count;
+  int32_t           used;
+  int32_t           clock_hand;
+  int64_t           hits;
+  int64_t           misses;
+  pthread_mutex_t   lock;
+} DentryCache;
+
+/**
+ * @brief A decoded indirect block held by the block map cache
+ */
+typedef struct block_map_entry {
+  int64_t block;
+  int8_t  valid;
+  int8_t  recent;  // Used more recently than the other entry of its set
+} BlockMapEntry;
+
+/**
+ * @brief Two way set associative cache of indirect blocks, so resolving a file's logical blocks doesn't
+ * go back through the block cache for every level of every block. Guarded by lock.
+ */
+typedef struct block_map_cache {
+  BlockMapEntry*  entries;
+  int32_t*        pointers;  // capacity slots of block_size / 4 block numbers each
+  int32_t         capacity;
+  int64_t         hits;
+  int64_t         misses;
+  pthread_mutex_t lock;
+} BlockMapCache;
+
+/**
+ * @brief Receives the data of a file one chunk at a time
+ * Returns EXIT_FAILURE to stop reading early.
+ */
+typedef int32_t (*FileChunkHandler)(int8_t* chunk, int64_t length, void* context);
+
+/**
+ * @brief Walks the entries of a directory, loading one directory block at a time
+ */
+typedef struct directory_iterator {
+  INode   inode;
+  int8_t* block;
+  int64_t block_pos;
+  int64_t block_count;
+  int64_t offset;           // Offset of the next entry in the loaded block
+  int64_t entry_offset;     // Offset of the last returned entry in the loaded block
+  int64_t previous_offset;  // Offset of the entry before it in the same block, or -1
+} DirectoryIterator;
+
+/**
+ * @brief An index block on the way from the root of a directory index to a leaf
+ */
+typedef struct htree_frame {
+  int8_t*  block;      // Copy of the index block
+  int64_t  block_pos;  // Directory block the index block lives in
+  DXEntry* entries;    // Entries inside block, the first one holds the count and limit
+  int32_t  entry;      // Entry that was followed
+} HTreeFrame;
+
+/**
+ * @brief Path from the root of a directory index to the leaf a hash falls in
+ */
+typedef struct htree_path {
+  HTreeFrame frames[HTREE_MAX_DEPTH];
+  int32_t    depth;
+  int32_t    hash_version;
+  uint32_t   hash;
+} HTreePath;
+
+/**
+ * @brief Hash and position of a directory entry while a leaf is split
+ */
+typedef struct htree_map_entry {
+  uint32_t hash;
+  int32_t  offset;
+  int32_t  size;  // Smallest rec_len the entry fits in
+} HTreeMapEntry;
+
+/**
+ * @brief Direction of an IO operation
+ */
+enum IOMode { IOMODE_READ, IOMODE_WRITE } typedef IOMode;
+
+/**
+ * @brief The two bitmaps every group has
+ */
+enum BitmapType { BITMAP_BLOCK, BITMAP_INODE } typedef BitmapType;
+
+/**
+ * @brief Block and INode bitmaps of every group, kept in memory once read so allocating only
+ * touches memory. Dirty bitmaps are written back on sync, on exit, or once flush_interval has
+ * passed. A summary of which groups are full lets allocators skip them without reading their
+ * bitmaps. A group's bitmaps and descriptor only change with the group's lock held.
+ */
+typedef struct bitmap_cache {
+  int8_t*          bitmaps;         // One block each, a group's block bitmap then its INodes
+  int8_t*          loaded;          // Per bitmap
+  int8_t*          dirty;           // Per bitmap
+  int8_t*          full_groups[2];  // Per BitmapType, one bit per group that has nothing free
+  int32_t          flush_interval;  // Seconds a dirty bitmap may wait to be written back
+  _Atomic time_t   last_flush;
+  _Atomic int64_t  writes;
+  pthread_mutex_t* group_locks;  // Per group
+} BitmapCache;
+
+/**
+ * @brief Blocks claimed together that are handed out one at a time
+ */
+typedef struct block_run {
+  int64_t next;  // Next block to hand out, or the block after the run once it is used up
+  int64_t left;
+} BlockRun;
+
+/**
+ * @brief Block numbers gathered up to be freed together
+ */
+typedef struct block_list {
+  int64_t* blocks;
+  int64_t  count;
+  int64_t  capacity;
+} BlockList;
+
+/**
+ * @brief Blocks claimed past the end of growing files so their next blocks follow on without
+ * another search. A window is found by the block it continues from, it stays marked in the
+ * bitmaps until it is used or released on sync, on exit, or when its file is freed. Guarded by
+ * lock.
+ */
+typedef struct prealloc_cache {
+  BlockRun*       windows;   // left == 0 for unused slots
+  int32_t         capacity;
+  int32_t         hand;      // Next slot to give up when every slot is used
+  _Atomic int64_t reserved;  // Blocks held by windows
+  int64_t         hits;
+  pthread_mutex_t lock;
+} PreallocCache;
+
+/**
+ * @brief INodes whose last link is gone but whose blocks are still being freed. They are chained
+ * on the disk the way ext3 does it, the superblock's s_last_orphan holds the first and each
+ * orphan's i_dtime the next, so a reclaim cut short is finished on the next mount. A background
+ * thread frees them a slice at a time. The chain and the counts are guarded by lock.
+ */
+typedef struct orphan_list {
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;
+  int64_t         head;         // First orphan, 0 for none
+  int64_t         pending;      // Orphans on the chain
+  int64_t         current;      // Orphan being reclaimed, 0 for none
+  int64_t         blocks_left;  // Blocks of the current orphan still to free
+  int64_t         reclaimed_inodes;
+  int64_t         reclaimed_blocks;
+  int8_t          running;
+  int8_t          stopping;  // Stop once the chain is empty
+} OrphanList;
+
+/**
+ * @brief Result of using a directory index
+ * UNINDEXED = the directory has no usable index, a linear scan is needed
+ */
+enum HTreeResult { HTREE_FOUND, HTREE_NOT_FOUND, HTREE_UNINDEXED } typedef HTreeResult;
+
+/**
+ * @brief Result of looking a name up in the directory entry cache
+ */
+enum DentryLookup { DENTRY_MISS, DENTRY_FOUND, DENTRY_NOT_FOUND } typedef DentryLookup;
+
+/**
+ * @brief How the disk image is accessed
+ * FD = pread/pwrite on the image file, MMAP = the whole image mapped into memory
+ */
+enum DiskBackend { DISK_BACKEND_FD, DISK_BACKEND_MMAP } typedef DiskBackend;
 
 /**
  * @brief Keeps track of disk infomation
  */
 typedef struct disk_info {
-  int32_t file_desc;
-  int64_t block_size;
-  int64_t block_count;
-  int64_t free_blocks;
-  int64_t free_inodes;
-  int64_t inode_count;
-  int32_t s_log_block_size;
-  int32_t inodes_per_group;
-  int32_t blocks_per_group;
-  int32_t group_count;
+  int32_t         file_desc;
+  int64_t         block_size;
+  int64_t         block_count;
+  _Atomic int64_t free_blocks;
+  _Atomic int64_t free_inodes;
+  int64_t         inode_count;
+  int32_t         s_log_block_size;
+  int32_t         inodes_per_group;
+  int32_t         blocks_per_group;
+  int32_t         group_count;
+  int32_t         inode_size;
+  BlockCache*     block_cache;
+  INodeCache*     inode_cache;
+  DentryCache*    dentry_cache;
+  BlockMapCache*  block_map_cache;
+  BitmapCache*    bitmap_cache;
+  PreallocCache*  prealloc_cache;
+  OrphanList*     orphans;
+  DiskBackend     backend;
+  int8_t*         map;
+  int64_t         map_length;
+  GroupDesc*      group_descs;
+  int64_t         group_desc_block;
+  _Atomic int8_t  group_descs_dirty;
+  uint32_t        hash_seed[4];
+  int8_t          hash_version;   // Hash used when a directory gets a new index
+  int8_t          hash_unsigned;  // Added to signed hash versions when names hash as unsigned
+  int8_t          dir_index;      // Directories get an index once they outgrow a block
+  int8_t          zero_freed;     // Freed blocks are zeroed on the disk
 } DiskInfo;
 
+/**
+ * @brief What a tree walk keeps of what it finds
+ */
+enum WalkMode { WALK_DU, WALK_FIND, WALK_TREE } typedef WalkMode;
+
+/**
+ * @brief A directory waiting to be read by a walker thread
+ */
+typedef struct walk_item {
+  int64_t inode_no;
+  int32_t depth;
+  char*   path;  // Owned by the item
+} WalkItem;
+
+/**
+ * @brief Something a walker thread found, kept until every thread is done
+ */
+typedef struct walk_record {
+  char*   path;
+  int64_t blocks;  // du: blocks of the directory and the files directly in it
+  int32_t depth;
+  uint8_t file_type;
+} WalkRecord;
+
+/**
+ * @brief Directories queued by a walker thread. The owner works from the tail, idle threads
+ * steal from the head, so a thief takes the oldest and likely largest subtree.
+ */
+typedef struct walk_queue {
+  WalkItem*       items;
+  int64_t         head;
+  int64_t         tail;
+  int64_t         capacity;
+  pthread_mutex_t lock;
+} WalkQueue;
+
+/**
+ * @brief One thread of a tree walk, with its own queue and its own results
+ */
+typedef struct walk_worker {
+  pthread_t      thread;
+  struct walker* walker;
+  int32_t        index;
+  WalkQueue      queue;
+  WalkRecord*    records;
+  int64_t        record_count;
+  int64_t        record_capacity;
+  int64_t        directories;
+  int64_t        files;
+} WalkWorker;
+
+/**
+ * @brief A directory tree walked by a pool of threads
+ */
+typedef struct walker {
+  DiskInfo*       disk_info;
+  WalkMode        mode;
+  char*           pattern;  // find: names to report, NULL for everything
+  WalkWorker*     workers;
+  int32_t         worker_count;
+  _Atomic int64_t pending;  // Directories queued or being read
+  int8_t*         visited;  // One bit per INode, set the first time the INode is reached
+} Walker;
+
 /**
  * @brief Struct to hold ext2 info
  */
@@ -93,7 +443,14 @@ enum Command {
   BLOCKBITMAP,
   INODEBITMAP,
   RAWBLOCK,
-  PWD
+  PWD,
+  PUT,
+  GET,
+  SYNC,
+  STATUS,
+  DU,
+  FIND,
+  TREE
 } typedef Command;
 
 /**
@@ -12,8 +12,11 @@
  */
 void initializeFilesystem(DiskInfo* disk_info, ExtInfo* ext_info) {
   // The superblock is located at an offset of 1024 bytes, ie, the first block.
-  ioBytes(disk_info, (int8_t*)&ext_info->super_block, sizeof(struct ext2_super_block),
-          SUPERBLOCK_OFFSET, IOMODE_READ);
+  if (ioBytes(disk_info, (int8_t*)&ext_info->super_block, sizeof(struct ext2_super_block),
+              SUPERBLOCK_OFFSET, IOMODE_READ) == EXIT_FAILURE) {
+    printf("Unable to read the superblock\n");
+    exit(EXIT_FAILURE);
+  }
 
   if (ext_info->super_block.s_magic != EXT2_SUPER_MAGIC) {
     printf("Magical error with s_magic=%x (is this an EXT2 filesystem?)\n",
@@ -36,6 +39,11 @@ void initializeFilesystem(DiskInfo* disk_info, ExtInfo* ext_info) {
 
   disk_info->inode_count = ext_info->super_block.s_inodes_count;
 
+  // Revision 0 filesystems always use 128 byte INodes
+  disk_info->inode_size = ext_info->super_block.s_rev_level == 0
+                            ? (int32_t)sizeof(INode)
+                            : ext_info->super_block.s_inode_size;
+
   disk_info->group_count = (disk_info->block_count + ext_info->super_block.s_blocks_per_group - 1) /
                            ext_info->super_block.s_blocks_per_group;
 
@@ -43,19 +51,44 @@ void initializeFilesystem(DiskInfo* disk_info, ExtInfo* ext_info) {
                            ext_info->super_block.s_free_blocks_count;
 
   disk_info->free_inodes = ext_info->super_block.s_free_inodes_count;
-  // The group descriptor (for the first group) is the block right after the
-  // superblock, so read that in. Depending on the block size, it could be in
-  // the 2nd or 3rd block.
-  if (disk_info->block_size <= SUPERBLOCK_OFFSET) {
-    // Read the 3rd block
-    // readBytes(disk_info, disk_info->block_size * 2,
-    //          (int8_t *)&ext_info->super_block, sizeof(struct
-    //          ext2_group_desc));
-  } else {
-    // Read the 2nd block
-    // readBytes(disk_info, disk_info->block_size,
-    //          (int8_t *)&ext_info->super_block, sizeof(struct
-    //          ext2_group_desc));
+
+  // Directory index hashing
+  memcpy(disk_info->hash_seed, ext_info->super_block.s_hash_seed, sizeof(disk_info->hash_seed));
+  disk_info->hash_version = ext_info->super_block.s_def_hash_version;
+  disk_info->hash_unsigned =
+    ext_info->super_block.s_flags & EXT2_FLAGS_UNSIGNED_HASH ? EXT2_HASH_LEGACY_UNSIGNED : 0;
+  disk_info->dir_index =
+    (ext_info->super_block.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) != 0;
+
+  // Everything past the superblock goes through the block, INode, directory entry and block map
+  // caches
+  cacheInitialize(disk_info, BLOCK_CACHE_CAPACITY);
+  cacheInitializeINodes(disk_info, INODE_CACHE_CAPACITY);
+  cacheInitializeDentries(disk_info, DENTRY_CACHE_CAPACITY);
+  cacheInitializeBlockMap(disk_info, BLOCK_MAP_CACHE_CAPACITY);
+
+  // The group descriptor table is the block right after the superblock. Depending on the block
+  // size, it could be in the 2nd or 3rd block. Keep the whole table in memory from here on.
+  disk_info->group_desc_block = SUPERBLOCK_OFFSET / disk_info->block_size + 1;
+  disk_info->group_descs      = (GroupDesc*)calloc(disk_info->group_count, sizeof(GroupDesc));
+
+  if (disk_info->group_descs == NULL ||
+      ioGroupDescriptorTable(disk_info, IOMODE_READ) == EXIT_FAILURE) {
+    printf("Unable to load the group descriptor table\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Bitmaps are read the first time a group is allocated from, then stay in memory
+  cacheInitializeBitmaps(disk_info, BITMAP_FLUSH_INTERVAL);
+  cacheInitializePrealloc(disk_info, PREALLOC_CACHE_CAPACITY);
+
+  // INode tables are looked up in no particular order, so don't bother reading ahead of them
+  int64_t table_bytes  = (int64_t)disk_info->inodes_per_group * disk_info->inode_size;
+  int64_t table_blocks = (table_bytes + disk_info->block_size - 1) / disk_info->block_size;
+
+  for (int32_t group = 0; group < disk_info->group_count; group++) {
+    ioAdvise(disk_info, disk_info->group_descs[group].bg_inode_table, table_blocks,
+             IOADVICE_RANDOM);
   }
 
   // printDiskInfomation(ext_info, disk_info);
@@ -76,21 +109,129 @@ int32_t testBit(int8_t data, int8_t bit) {
 }
 
 /**
- * @brief Finds a free bit in a bitmap
+ * @brief Loads 64 bits of a bitmap, bit 0 of the word being the first bit of the bitmap
  *
- * @param data
- * @return int
+ * @param bitmap
+ * @param word
+ * @return uint64_t
+ */
+uint64_t loadBitmapWord(int8_t* bitmap, int64_t word) {
+  uint64_t bits;
+  memcpy(&bits, bitmap + word * sizeof(uint64_t), sizeof(uint64_t));
+
+  return le64toh(bits);
+}
+
+/**
+ * @brief Finds the first bit of a bitmap with a value, a 64 bit word at a time. With AVX2 runs of
+ * words without it are skipped 256 bits at a time first.
+ *
+ * @param bitmap
+ * @param start First bit to look at
+ * @param bit_count Bits in the bitmap
+ * @param value 0 for a free bit, 1 for a used one
+ * @return int64_t -1 if there is none
  */
-int32_t findFreeBit(int8_t data, int8_t start) {
-  for (int8_t bit_pos = start; bit_pos < 8 * sizeof(int8_t); bit_pos++) {
-    if (!testBit(data, bit_pos)) {
-      return bit_pos;
+int64_t findBit(int8_t* bitmap, int64_t start, int64_t bit_count, int8_t value) {
+  uint64_t flip = value ? 0 : UINT64_MAX;  // Turns the bits being looked for into ones
+  int64_t  word = start / 64;
+
+  // Bits before start are never a match
+  if (start % 64 != 0 && (word + 1) * 64 <= bit_count) {
+    uint64_t match = (loadBitmapWord(bitmap, word) ^ flip) & ~((1ULL << (start % 64)) - 1);
+
+    if (match != 0) {
+      return word * 64 + __builtin_ctzll(match);
+    }
+
+    word++;
+  }
+
+#ifdef __AVX2__
+  __m256i flip_lanes = _mm256_set1_epi64x(flip);
+
+  while ((word + 4) * 64 <= bit_count) {
+    __m256i match =
+      _mm256_xor_si256(_mm256_loadu_si256((__m256i*)(bitmap + word * 8)), flip_lanes);
+
+    if (!_mm256_testz_si256(match, match)) {
+      break;
+    }
+
+    word += 4;
+  }
+#endif
+
+  for (; (word + 1) * 64 <= bit_count; word++) {
+    uint64_t match = loadBitmapWord(bitmap, word) ^ flip;
+
+    if (match != 0) {
+      return word * 64 + __builtin_ctzll(match);
+    }
+  }
+
+  // The tail is shorter than a word
+  for (int64_t bit = word * 64 > start ? word * 64 : start; bit < bit_count; bit++) {
+    if (testBit(bitmap[bit / 8], bit % 8) == value) {
+      return bit;
     }
   }
 
   return -1;
 }
 
+/**
+ * @brief Finds the first free bit in a bitmap
+ *
+ * @param bitmap
+ * @param start First bit to look at
+ * @param bit_count Bits in the bitmap
+ * @return int64_t -1 if every bit is used
+ */
+int64_t findFreeBit(int8_t* bitmap, int64_t start, int64_t bit_count) {
+  return findBit(bitmap, start, bit_count, 0);
+}
+
+/**
+ * @brief Finds a run of free bits in a bitmap. The first run long enough wins, otherwise the
+ * longest run there is.
+ *
+ * @param bitmap
+ * @param start First bit to look at
+ * @param bit_count Bits in the bitmap
+ * @param count Bits wanted
+ * @param length Set to the length of the run, at most count
+ * @return int64_t First bit of the run, -1 if every bit is used
+ */
+int64_t findFreeRun(int8_t* bitmap, int64_t start, int64_t bit_count, int64_t count,
+                    int64_t* length) {
+  int64_t best_start  = -1;
+  int64_t best_length = 0;
+
+  for (int64_t run_start = findBit(bitmap, start, bit_count, 0); run_start != -1;) {
+    int64_t run_end = findBit(bitmap, run_start, bit_count, 1);
+
+    if (run_end == -1) {
+      run_end = bit_count;
+    }
+
+    if (run_end - run_start > best_length) {
+      best_start  = run_start;
+      best_length = run_end - run_start;
+    }
+
+    if (best_length >= count) {
+      break;
+    }
+
+    run_start = run_end < bit_count ? findBit(bitmap, run_end, bit_count, 0) : -1;
+  }
+
+  *length = best_length < count ? best_length : count;
+
+  return best_start;
+}
+
 /**
  * @brief Parses a path
  * Like strtok, but for paths and tells you when the path is about to be over.
@@ -138,6 +279,10 @@ void clearPath(State* state, Path* path) {
     free(current_pos->child);
   }
 
+  // The working directory INode stays pinned in the INode cache
+  cachePinINode(state->disk_info, state->path_root->inode_number);
+  cacheUnpinINode(state->disk_info, state->path_cwd->inode_number);
+
   state->path_cwd         = state->path_root;
   state->path_root->child = NULL;
 }
@@ -194,4 +339,15 @@ IndirectRange calculateIndirectRange(DiskInfo* disk_info) {
   range.indirects_per_block = indirects_per_block;
 
   return range;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Calculates the smallest rec_len a directory entry can have
+ *
+ * @param name_len
+ * @return int64_t
+ */
+int64_t calculateDirectoryEntryLength(int32_t name_len) {
+  // Entries start on 4 byte boundaries
+  return (8 + name_len + 3) & ~3;
+}
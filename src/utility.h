@@ -6,9 +6,14 @@
 #include "print.h"
 #include "types.h"
 
+#include <endian.h>
 #include <stdlib.h>
 #include <strings.h>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 /**
  * @brief Reads and prepares data structures for Filesystem
  *
@@ -26,14 +31,48 @@ void initializeFilesystem(DiskInfo* disk_info, ExtInfo* ext_info);
  */
 int32_t testBit(int8_t byte, int8_t bit);
 
+/**
+ * @brief Loads 64 bits of a bitmap
+ *
+ * @param bitmap
+ * @param word
+ * @return uint64_t
+ */
+uint64_t loadBitmapWord(int8_t* bitmap, int64_t word);
+
+/**
+ * @brief Finds the first bit of a bitmap with a value
+ *
+ * @param bitmap
+ * @param start bit to start at
+ * @param bit_count
+ * @param value 0 or 1
+ * @return int64_t -1 if there is none
+ */
+int64_t findBit(int8_t* bitmap, int64_t start, int64_t bit_count, int8_t value);
+
 /**
  * @brief Finds a free bit in a bitmap
  *
- * @param data
- * @param bit to start at
- * @return int
+ * @param bitmap
+ * @param start bit to start at
+ * @param bit_count
+ * @return int64_t -1 if there is none
+ */
+int64_t findFreeBit(int8_t* bitmap, int64_t start, int64_t bit_count);
+
+/**
+ * @brief Finds a run of free bits in a bitmap, the first one long enough or else the longest
+ *
+ * @param bitmap
+ * @param start bit to start at
+ * @param bit_count
+ * @param count bits wanted
+ * @param length set to the length of the run found, at most count
+ * @return int64_t first bit of the run, -1 if there is none
  */
-int32_t findFreeBit(int8_t data, int8_t start);
+int64_t findFreeRun(int8_t* bitmap, int64_t start, int64_t bit_count, int64_t count,
+                    int64_t* length);
 
 /**
  * @brief Like strtok, but not useless
@@ -77,4 +116,12 @@ int16_t getDefaultMode(int16_t file_type);
  */
 IndirectRange calculateIndirectRange(DiskInfo* disk_info);
 
+/**
+ * @brief Calculates the smallest rec_len a directory entry can have
+ *
+ * @param name_len
+ * @return int64_t
+ */
+int64_t calculateDirectoryEntryLength(int32_t name_len);
+
 #endif
\ No newline at end of file
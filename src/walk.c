@@ -0,0 +1,491 @@
+#include "walk.h"
+
+/**
+ * @brief Walks the tree under a directory with one thread per core. The calling thread works as
+ * the first walker. A directory is counted in pending from when it is queued until the
+ * directories in it are queued, so the walk is over once pending drops to zero.
+ *
+ * @param disk_info
+ * @param walker
+ * @param mode
+ * @param root_path Path the results are named under
+ * @param root_inode Directory to start from
+ * @param pattern find: names to report, NULL for everything
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t walkTree(DiskInfo* disk_info, Walker* walker, WalkMode mode, char* root_path,
+                 int64_t root_inode, char* pattern) {
+  int64_t thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (thread_count < 1) {
+    thread_count = 1;
+  } else if (thread_count > WALK_MAX_THREADS) {
+    thread_count = WALK_MAX_THREADS;
+  }
+
+  bzero(walker, sizeof(Walker));
+  walker->disk_info    = disk_info;
+  walker->mode         = mode;
+  walker->pattern      = pattern;
+  walker->worker_count = thread_count;
+  walker->workers      = (WalkWorker*)calloc(thread_count, sizeof(WalkWorker));
+  walker->visited      = (int8_t*)calloc(disk_info->inode_count / 8 + 1, sizeof(int8_t));
+
+  if (walker->workers == NULL || walker->visited == NULL) {
+    printf("walk: walkTree(): error: Unable to allocate the walker\n");
+    free(walker->workers);
+    free(walker->visited);
+    walker->workers = NULL;
+    walker->visited = NULL;
+    return EXIT_FAILURE;
+  }
+
+  for (int32_t pos = 0; pos < thread_count; pos++) {
+    walker->workers[pos].walker = walker;
+    walker->workers[pos].index  = pos;
+    pthread_mutex_init(&walker->workers[pos].queue.lock, NULL);
+  }
+
+  WalkItem root = { root_inode, 0, strdup(root_path) };
+
+  walkVisit(walker, root_inode);
+  walker->pending = 1;
+  walkPush(&walker->workers[0], &root);
+
+  // Threads that fail to start leave their queues empty, the others do their share
+  int32_t started = 1;
+
+  for (; started < thread_count; started++) {
+    WalkWorker* worker = &walker->workers[started];
+
+    if (pthread_create(&worker->thread, NULL, walkRun, worker) != 0) {
+      printf("walk: walkTree(): error: Unable to start walker %d\n", started);
+      break;
+    }
+  }
+
+  walkRun(&walker->workers[0]);
+
+  for (int32_t pos = 1; pos < started; pos++) {
+    pthread_join(walker->workers[pos].thread, NULL);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Queues a directory on a worker, growing the queue when it is full. Taken items leave
+ * a gap at the head that is closed before the queue grows.
+ *
+ * @param worker
+ * @param item
+ */
+void walkPush(WalkWorker* worker, WalkItem* item) {
+  WalkQueue* queue = &worker->queue;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if (queue->tail == queue->capacity) {
+    if (queue->head > 0) {
+      memmove(queue->items, queue->items + queue->head,
+              (queue->tail - queue->head) * sizeof(WalkItem));
+      queue->tail -= queue->head;
+      queue->head = 0;
+    }
+
+    if (queue->tail == queue->capacity) {
+      int64_t   capacity = queue->capacity == 0 ? WALK_QUEUE_CAPACITY : queue->capacity * 2;
+      WalkItem* items    = (WalkItem*)realloc(queue->items, capacity * sizeof(WalkItem));
+
+      if (items == NULL) {
+        printf("walk: walkPush(): error: Unable to grow the queue\n");
+        exit(EXIT_FAILURE);
+      }
+
+      queue->items    = items;
+      queue->capacity = capacity;
+    }
+  }
+
+  queue->items[queue->tail++] = *item;
+
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Takes the newest directory off a worker's own queue. Going deep first keeps the queue
+ * short and leaves the wide top of the tree for thieves.
+ *
+ * @param worker
+ * @param item
+ * @return int8_t 1 if there was one
+ */
+int8_t walkPop(WalkWorker* worker, WalkItem* item) {
+  WalkQueue* queue = &worker->queue;
+  int8_t     found = 0;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if (queue->tail > queue->head) {
+    *item = queue->items[--queue->tail];
+    found = 1;
+
+    if (queue->tail == queue->head) {
+      queue->head = 0;
+      queue->tail = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return found;
+}
+
+/**
+ * @brief Takes the oldest directory off another worker's queue
+ *
+ * @param victim
+ * @param item
+ * @return int8_t 1 if there was one
+ */
+int8_t walkSteal(WalkWorker* victim, WalkItem* item) {
+  WalkQueue* queue = &victim->queue;
+  int8_t     found = 0;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if (queue->tail > queue->head) {
+    *item = queue->items[queue->head++];
+    found = 1;
+
+    if (queue->tail == queue->head) {
+      queue->head = 0;
+      queue->tail = 0;
+    }
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return found;
+}
+
+/**
+ * @brief Marks an INode as reached. Hard links and damaged trees can reach an INode more than
+ * once, it is only descended into and counted the first time.
+ *
+ * @param walker
+ * @param inode_no
+ * @return int8_t 1 if it was reached for the first time
+ */
+int8_t walkVisit(Walker* walker, int64_t inode_no) {
+  if (inode_no < 1 || inode_no > walker->disk_info->inode_count) {
+    return 0;
+  }
+
+  int64_t bit  = inode_no - 1;
+  int8_t  mask = (int8_t)(1 << (bit % 8));
+
+  return (__atomic_fetch_or(&walker->visited[bit / 8], mask, __ATOMIC_RELAXED) & mask) == 0;
+}
+
+/**
+ * @brief Keeps a result on the worker that found it
+ *
+ * @param worker
+ * @param path Taken over by the record
+ * @param blocks
+ * @param depth
+ * @param file_type
+ */
+void walkRecord(WalkWorker* worker, char* path, int64_t blocks, int32_t depth, uint8_t file_type) {
+  if (worker->record_count == worker->record_capacity) {
+    int64_t     capacity = worker->record_capacity == 0 ? WALK_QUEUE_CAPACITY
+                                                        : worker->record_capacity * 2;
+    WalkRecord* records  = (WalkRecord*)realloc(worker->records, capacity * sizeof(WalkRecord));
+
+    if (records == NULL) {
+      printf("walk: walkRecord(): error: Unable to grow the results\n");
+      exit(EXIT_FAILURE);
+    }
+
+    worker->records         = records;
+    worker->record_capacity = capacity;
+  }
+
+  WalkRecord* record = &worker->records[worker->record_count++];
+
+  record->path      = path;
+  record->blocks    = blocks;
+  record->depth     = depth;
+  record->file_type = file_type;
+}
+
+/**
+ * @brief Reads one directory under its INode lock. Only one INode is locked at a time, so
+ * walkers never wait on each other in a cycle, and commands that lock a parent before its child
+ * still get in between two directories.
+ *
+ * @param worker
+ * @param item
+ */
+void walkDirectory(WalkWorker* worker, WalkItem* item) {
+  Walker*           walker    = worker->walker;
+  DiskInfo*         disk_info = walker->disk_info;
+  DirectoryIterator iterator;
+  Directory         entry;
+  int64_t           blocks = 0;
+
+  cacheLockINode(disk_info, item->inode_no);
+
+  if (ioDirectoryOpen(disk_info, &iterator, item->inode_no) == EXIT_FAILURE) {
+    cacheUnlockINode(disk_info, item->inode_no);
+    return;
+  }
+
+  blocks = (iterator.inode.i_size + disk_info->block_size - 1) / disk_info->block_size;
+
+  while (ioDirectoryNext(disk_info, &iterator, &entry) == EXIT_SUCCESS) {
+    if (strcmp(entry.name, ".") == 0 || strcmp(entry.name, "..") == 0) {
+      continue;
+    }
+
+    int8_t first = walkVisit(walker, entry.inode);
+
+    if (entry.file_type == EXT2_FT_DIR) {
+      worker->directories++;
+    } else {
+      worker->files++;
+    }
+
+    if (walker->mode == WALK_DU && first && entry.file_type != EXT2_FT_DIR) {
+      INode   inode;
+      int64_t size;
+
+      if (ioINode(disk_info, &inode, entry.inode, IOMODE_READ) == EXIT_SUCCESS) {
+        size = (int64_t)inode.i_size_high << 32 | inode.i_size;
+        blocks += (size + disk_info->block_size - 1) / disk_info->block_size;
+      }
+    }
+
+    if (walker->mode == WALK_TREE ||
+        (walker->mode == WALK_FIND &&
+         (walker->pattern == NULL || fnmatch(walker->pattern, entry.name, 0) == 0))) {
+      walkRecord(worker, walkJoinPath(item->path, entry.name), 0, item->depth + 1,
+                 entry.file_type);
+    }
+
+    if (entry.file_type == EXT2_FT_DIR && first) {
+      WalkItem child = { entry.inode, item->depth + 1, walkJoinPath(item->path, entry.name) };
+
+      walker->pending++;
+      walkPush(worker, &child);
+    }
+  }
+
+  ioDirectoryClose(&iterator);
+  cacheUnlockINode(disk_info, item->inode_no);
+
+  if (walker->mode == WALK_DU) {
+    walkRecord(worker, strdup(item->path), blocks, item->depth, EXT2_FT_DIR);
+  }
+}
+
+/**
+ * @brief Body of a walker thread. Works through its own queue, then tries every other queue in
+ * turn starting from its neighbour. Nothing to take while pending is above zero means another
+ * walker is still reading a directory that may queue more.
+ *
+ * @param argument WalkWorker
+ * @return void*
+ */
+void* walkRun(void* argument) {
+  WalkWorker* worker = (WalkWorker*)argument;
+  Walker*     walker = worker->walker;
+  WalkItem    item;
+
+  while (1) {
+    int8_t found = walkPop(worker, &item);
+
+    for (int32_t pos = 1; !found && pos < walker->worker_count; pos++) {
+      found = walkSteal(&walker->workers[(worker->index + pos) % walker->worker_count], &item);
+    }
+
+    if (found) {
+      walkDirectory(worker, &item);
+      free(item.path);
+      walker->pending--;
+      continue;
+    }
+
+    if (walker->pending == 0) {
+      break;
+    }
+
+    sched_yield();
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Joins a child name onto a path
+ *
+ * @param path
+ * @param name
+ * @return char* Allocated path
+ */
+char* walkJoinPath(char* path, char* name) {
+  int64_t length    = strlen(path);
+  int8_t  separator = length == 0 || path[length - 1] != '/';
+  char*   joined    = (char*)malloc(length + separator + strlen(name) + 1);
+
+  if (joined == NULL) {
+    printf("walk: walkJoinPath(): error: Unable to allocate a path\n");
+    exit(EXIT_FAILURE);
+  }
+
+  strcpy(joined, path);
+
+  if (separator) {
+    joined[length++] = '/';
+  }
+
+  strcpy(joined + length, name);
+
+  return joined;
+}
+
+/**
+ * @brief Orders paths the way a depth first walk reaches them. '/' sorts before any other
+ * character so "a/b" comes right after "a" and before "a-b".
+ *
+ * @param a WalkRecord
+ * @param b WalkRecord
+ * @return int32_t
+ */
+int32_t walkComparePaths(const void* a, const void* b) {
+  const unsigned char* left  = (const unsigned char*)((const WalkRecord*)a)->path;
+  const unsigned char* right = (const unsigned char*)((const WalkRecord*)b)->path;
+
+  while (*left != '\0' && *left == *right) {
+    left++;
+    right++;
+  }
+
+  int32_t left_char  = *left == '/' ? 1 : *left;
+  int32_t right_char = *right == '/' ? 1 : *right;
+
+  return left_char - right_char;
+}
+
+/**
+ * @brief Gathers every worker's results into one list sorted by path and adds up their counts.
+ * The workers keep nothing afterwards.
+ *
+ * @param walker
+ * @param records Set to the sorted list, owned by the caller along with the paths in it
+ * @param count Set to the length of the list
+ * @param directories Set to the directories reached, without the root
+ * @param files Set to the other entries reached
+ */
+void walkMerge(Walker* walker, WalkRecord** records, int64_t* count, int64_t* directories,
+               int64_t* files) {
+  int64_t total = 0;
+
+  *directories = 0;
+  *files       = 0;
+
+  for (int32_t pos = 0; pos < walker->worker_count; pos++) {
+    total += walker->workers[pos].record_count;
+    *directories += walker->workers[pos].directories;
+    *files += walker->workers[pos].files;
+  }
+
+  *records = (WalkRecord*)malloc((total > 0 ? total : 1) * sizeof(WalkRecord));
+  *count   = 0;
+
+  if (*records == NULL) {
+    printf("walk: walkMerge(): error: Unable to allocate the results\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int32_t pos = 0; pos < walker->worker_count; pos++) {
+    WalkWorker* worker = &walker->workers[pos];
+
+    memcpy(*records + *count, worker->records, worker->record_count * sizeof(WalkRecord));
+    *count += worker->record_count;
+
+    free(worker->records);
+    worker->records         = NULL;
+    worker->record_count    = 0;
+    worker->record_capacity = 0;
+  }
+
+  qsort(*records, *count, sizeof(WalkRecord), walkComparePaths);
+}
+
+/**
+ * @brief Adds the blocks of every directory into its parent's. Sorted records reach a directory
+ * right after its parent, so a stack of the open directories is enough: whatever is not an
+ * ancestor of the next record is finished and handed up.
+ *
+ * @param records
+ * @param count
+ */
+void walkSumDirectories(WalkRecord* records, int64_t count) {
+  int64_t* stack = (int64_t*)malloc((count > 0 ? count : 1) * sizeof(int64_t));
+  int64_t  depth = 0;
+
+  if (stack == NULL) {
+    printf("walk: walkSumDirectories(): error: Unable to allocate the stack\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int64_t pos = 0; pos <= count; pos++) {
+    while (depth > 0 && (pos == count || records[pos].depth <= records[stack[depth - 1]].depth)) {
+      depth--;
+
+      if (depth > 0) {
+        records[stack[depth - 1]].blocks += records[stack[depth]].blocks;
+      }
+    }
+
+    if (pos < count) {
+      stack[depth++] = pos;
+    }
+  }
+
+  free(stack);
+}
+
+/**
+ * @brief Frees the results of a merge
+ *
+ * @param records
+ * @param count
+ */
+void walkFreeRecords(WalkRecord* records, int64_t count) {
+  for (int64_t pos = 0; pos < count; pos++) {
+    free(records[pos].path);
+  }
+
+  free(records);
+}
+
+/**
+ * @brief Frees what a walk left behind after walkMerge()
+ *
+ * @param walker
+ */
+void walkRelease(Walker* walker) {
+  for (int32_t pos = 0; pos < walker->worker_count; pos++) {
+    free(walker->workers[pos].records);
+    free(walker->workers[pos].queue.items);
+    pthread_mutex_destroy(&walker->workers[pos].queue.lock);
+  }
+
+  free(walker->workers);
+  free(walker->visited);
+  walker->workers = NULL;
+  walker->visited = NULL;
+}
@@ -0,0 +1,159 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include "cache.h"
+#include "io.h"
+#include "types.h"
+
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * @brief Most threads a tree walk starts
+ */
+#define WALK_MAX_THREADS 16
+
+/**
+ * @brief Directories a walker queue holds before it first grows
+ */
+#define WALK_QUEUE_CAPACITY 64
+
+/**
+ * @brief Walks the tree under a directory with one thread per core. Each thread reads the
+ * directories on its own queue and steals from the others when it runs dry. Results stay with
+ * the thread that found them until walkMerge().
+ *
+ * @param disk_info
+ * @param walker
+ * @param mode
+ * @param root_path Path the results are named under
+ * @param root_inode Directory to start from
+ * @param pattern find: names to report, NULL for everything
+ * @return int32_t EXIT_SUCCESS or EXIT_FAILURE
+ */
+int32_t walkTree(DiskInfo* disk_info, Walker* walker, WalkMode mode, char* root_path,
+                 int64_t root_inode, char* pattern);
+
+/**
+ * @brief Queues a directory on a worker. The walk's pending count must already include it.
+ *
+ * @param worker
+ * @param item
+ */
+void walkPush(WalkWorker* worker, WalkItem* item);
+
+/**
+ * @brief Takes the newest directory off a worker's own queue
+ *
+ * @param worker
+ * @param item
+ * @return int8_t 1 if there was one
+ */
+int8_t walkPop(WalkWorker* worker, WalkItem* item);
+
+/**
+ * @brief Takes the oldest directory off another worker's queue
+ *
+ * @param victim
+ * @param item
+ * @return int8_t 1 if there was one
+ */
+int8_t walkSteal(WalkWorker* victim, WalkItem* item);
+
+/**
+ * @brief Marks an INode as reached
+ *
+ * @param walker
+ * @param inode_no
+ * @return int8_t 1 if it was reached for the first time
+ */
+int8_t walkVisit(Walker* walker, int64_t inode_no);
+
+/**
+ * @brief Keeps a result on the worker that found it
+ *
+ * @param worker
+ * @param path Taken over by the record
+ * @param blocks
+ * @param depth
+ * @param file_type
+ */
+void walkRecord(WalkWorker* worker, char* path, int64_t blocks, int32_t depth, uint8_t file_type);
+
+/**
+ * @brief Reads one directory, queueing the directories in it and recording what the walk's mode
+ * asks for
+ *
+ * @param worker
+ * @param item
+ */
+void walkDirectory(WalkWorker* worker, WalkItem* item);
+
+/**
+ * @brief Body of a walker thread
+ *
+ * @param argument WalkWorker
+ * @return void*
+ */
+void* walkRun(void* argument);
+
+/**
+ * @brief Joins a child name onto a path
+ *
+ * @param path
+ * @param name
+ * @return char* Allocated path
+ */
+char* walkJoinPath(char* path, char* name);
+
+/**
+ * @brief Orders paths the way a depth first walk reaches them, a directory before what is in it
+ *
+ * @param a WalkRecord
+ * @param b WalkRecord
+ * @return int32_t
+ */
+int32_t walkComparePaths(const void* a, const void* b);
+
+/**
+ * @brief Gathers every worker's results into one list sorted by path and adds up their counts
+ *
+ * @param walker
+ * @param records Set to the sorted list, owned by the caller along with the paths in it
+ * @param count Set to the length of the list
+ * @param directories Set to the directories reached, without the root
+ * @param files Set to the other entries reached
+ */
+void walkMerge(Walker* walker, WalkRecord** records, int64_t* count, int64_t* directories,
+               int64_t* files);
+
+/**
+ * @brief Adds the blocks of every directory into its parent's, records must be sorted by
+ * walkMerge()
+ *
+ * @param records
+ * @param count
+ */
+void walkSumDirectories(WalkRecord* records, int64_t count);
+
+/**
+ * @brief Frees the results of a merge
+ *
+ * @param records
+ * @param count
+ */
+void walkFreeRecords(WalkRecord* records, int64_t count);
+
+/**
+ * @brief Frees what a walk left behind after walkMerge()
+ *
+ * @param walker
+ */
+void walkRelease(Walker* walker);
+
+#endif